@@ -0,0 +1,13 @@
+#version 430 core
+layout(location = 0) in vec3 pos;
+layout(location = 1) in uint drawId;
+
+layout(std430, binding = 0) readonly buffer Objects {
+  mat4 models[];
+};
+
+uniform mat4 viewProjection;
+
+void main() {
+  gl_Position = viewProjection * models[drawId] * vec4(pos, 1.0);
+}
@@ -0,0 +1,11 @@
+#version 330 core
+
+in vec3 viewNormal;
+
+out vec4 color;
+
+void main() {
+  // Headlight, the light sits at the camera and looks down -z
+  float diffuse = max(dot(normalize(viewNormal), vec3(0.0, 0.0, 1.0)), 0.0);
+  color = vec4(vec3(1.0f, 0.5f, 0.2f) * (0.15 + 0.85 * diffuse), 1.0f);
+}
\ No newline at end of file
@@ -0,0 +1,14 @@
+#version 330 core
+layout(location = 0) in vec3 pos;
+layout(location = 1) in vec3 normal;
+
+uniform mat4 mvp;
+uniform mat4 modelView;
+
+out vec3 viewNormal;
+
+void main() {
+  // Rotation and uniform scale only, so no inverse transpose needed
+  viewNormal = mat3(modelView) * normal;
+  gl_Position = mvp * vec4(pos, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+
+// Opt-in global allocation tracking, configure with -DOBJ_LOADER_TRACK_ALLOCATIONS=ON.
+// When enabled the global operator new/delete are replaced and every allocation is
+// charged to the subsystem of the innermost AllocScope on the allocating thread.
+// When disabled everything here is a no-op.
+
+enum class AllocSubsystem : uint8_t
+{
+	Other,
+	MeshLoad,
+	MeshProcessing,
+	Export,
+	Chunks,
+	Render,
+	Count
+};
+
+struct AllocCounters
+{
+	uint64_t count = 0;		// allocations made
+	uint64_t bytes = 0;		// bytes allocated in total
+	uint64_t liveBytes = 0;
+	uint64_t peakBytes = 0;
+};
+
+class AllocTracker
+{
+public:
+	static bool IsEnabled();
+	static const char* GetName(AllocSubsystem subsystem);
+	static AllocCounters Get(AllocSubsystem subsystem);
+	static AllocCounters GetTotal();
+};
+
+// Charges allocations made on this thread to a subsystem while in scope
+class AllocScope
+{
+public:
+	explicit AllocScope(AllocSubsystem subsystem);
+	~AllocScope();
+
+	AllocScope(const AllocScope&) = delete;
+	AllocScope& operator=(const AllocScope&) = delete;
+
+private:
+	AllocSubsystem mPrevious;
+};
@@ -11,6 +11,7 @@ public:
     void Zoom(float zoom);
     void Translate(float dx, float dy);
     glm::mat4 GetViewMatrix() const;
+    glm::vec3 GetPosition() const;
     
 
 private:
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "chunk_format.hpp"
+#include "mesh.hpp"
+
+struct ChunkBuildOptions
+{
+	size_t leafTriangles = 1 << 16;		// target triangle count of every chunk
+	size_t memoryBudget = 512ull << 20;	// vertex page cache plus triangle spill buffers
+};
+
+struct ChunkBuildStats
+{
+	size_t vertices = 0;
+	size_t triangles = 0;
+	size_t nodes = 0;
+	size_t leaves = 0;
+	unsigned int depth = 0;
+	uint64_t bytesWritten = 0;
+};
+
+// Streams an OBJ of any size into an octree of chunks on disk (see chunk_format.hpp).
+// Positions are spilled to a temporary file and paged back in, triangles are
+// bucketed into grid cells by centroid, cells with more than leafTriangles are
+// split further until every leaf fits, then every inner node is built bottom
+// up by merging and simplifying its children. Only the memory budget plus
+// one root to leaf path of chunks is held in RAM.
+class ChunkBuilder
+{
+public:
+	ChunkBuilder(std::filesystem::path source, std::filesystem::path output, ChunkBuildOptions options = {});
+
+	ChunkBuildStats Build();
+
+private:
+	struct BuildRecord
+	{
+		ChunkNode node;
+		std::vector<uint32_t> children;
+	};
+
+	void ScanVertices();
+	void PartitionTriangles();
+	void FlushSpills();
+	uint32_t BuildNode(unsigned int level, const uint64_t* first, const uint64_t* last, MeshData& geometry);
+	uint32_t BuildCell(unsigned int level, unsigned int refined, const std::filesystem::path& path, MeshData& geometry);
+	std::vector<std::filesystem::path> SplitCell(const std::filesystem::path& path, bool spatial) const;
+	void AddChild(uint32_t index, const MeshData& child, BuildRecord& record, float& childError, MeshData& geometry) const;
+	uint32_t FinishNode(BuildRecord record, MeshData& geometry, float childError, bool inner);
+	void ReadLeaf(const std::filesystem::path& path, MeshData& data) const;
+	void WriteHierarchy() const;
+	std::filesystem::path SpillPath(uint64_t code) const;
+
+	std::filesystem::path mSource, mOutput, mTemp;
+	ChunkBuildOptions mOptions;
+	ChunkBuildStats mStats;
+
+	glm::vec3 mLower, mUpper;
+	float mCellSize;
+	unsigned int mGridDepth;	// level of the grid cells, leaves of oversized cells are deeper
+
+	std::unordered_map<uint64_t, std::vector<glm::vec3>> mSpills;
+	size_t mSpillBytes;
+	std::vector<uint64_t> mLeafCodes;
+
+	std::ofstream mChunkFile;
+	std::vector<BuildRecord> mRecords;
+};
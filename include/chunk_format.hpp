@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+
+// On disk layout of an out-of-core mesh directory written by ChunkBuilder.
+// hierarchy.bin holds a ChunkFileHeader followed by the node table, node 0
+// is the root and the children of a node are stored next to each other.
+// chunks.bin holds the vertices (3 floats) and then the indices (uint32_t)
+// of every node back to back, coarser nodes are simplified versions of
+// their children.
+
+inline constexpr char kChunkMagic[4] = { 'O', 'C', 'H', 'K' };
+inline constexpr uint32_t kChunkVersion = 1;
+inline constexpr const char* kChunkHierarchyFile = "hierarchy.bin";
+inline constexpr const char* kChunkDataFile = "chunks.bin";
+
+struct ChunkFileHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t nodeCount;
+	uint32_t depth;
+};
+
+struct ChunkNode
+{
+	float lower[3];
+	float upper[3];
+	float error;			// geometric error in model units, 0 for full resolution leaves
+	uint32_t firstChild;
+	uint32_t childCount;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t reserved;
+	uint64_t offset;		// byte offset into chunks.bin
+
+	uint64_t GetByteSize() const
+	{
+		return vertexCount * uint64_t{ 12 } + indexCount * uint64_t{ 4 };
+	}
+};
+
+static_assert(sizeof(ChunkNode) == 56, "ChunkNode is written to disk as is");
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+#include "chunk_format.hpp"
+
+struct ChunkCacheStats
+{
+	uint64_t accesses = 0;		// chunks the selection wanted to draw, summed over frames
+	uint64_t vramHits = 0;		// of those, already on the GPU
+	uint64_t ramHits = 0;		// uploaded from the RAM cache without touching the disk
+	uint64_t diskReads = 0;
+	uint64_t evictions = 0;
+	uint64_t deferred = 0;		// loads skipped because the budget was pinned by visible chunks
+	uint64_t bytesRead = 0;
+	double readSeconds = 0.0;
+
+	size_t ramBytes = 0, ramBudget = 0;
+	size_t vramBytes = 0, vramBudget = 0;
+	unsigned int drawnChunks = 0;
+	unsigned int drawnTriangles = 0;
+	unsigned int pendingReads = 0;
+
+	double GetHitRate() const;
+	double GetReadThroughput() const;	// MB/s while reading
+};
+
+// Viewer side of an out-of-core mesh written by ChunkBuilder. Every frame
+// the hierarchy is refined until the screen-space error of a node is below
+// the threshold; chunks are read by a background thread into an LRU RAM
+// cache and uploaded into an LRU VRAM cache. Both caches stay within their
+// budget, chunks drawn this frame are never evicted and a coarser resident
+// ancestor is drawn until the wanted chunks arrive.
+class ChunkedMesh
+{
+public:
+	ChunkedMesh(const std::filesystem::path& directory, size_t ramBudget, size_t vramBudget);
+	~ChunkedMesh();
+
+	ChunkedMesh(const ChunkedMesh&) = delete;
+	ChunkedMesh& operator=(const ChunkedMesh&) = delete;
+
+	// model is the full model matrix including GetNormalizeMatrix
+	void Update(const glm::mat4& model, const glm::vec3& eye, float fieldOfView, float viewportHeight);
+	void Draw() const;
+
+	// Centers and scales the whole mesh to unit size, like Mesh::Load does
+	glm::mat4 GetNormalizeMatrix() const;
+	const ChunkCacheStats& GetStats() const;
+	float GetErrorThreshold() const;
+	void SetErrorThreshold(float pixels);
+
+private:
+	struct ChunkState
+	{
+		std::vector<char> data;		// RAM copy, vertices then indices
+		bool inRam = false;
+		bool reading = false;
+		GLuint vao = 0, vbo = 0, ebo = 0;
+		uint64_t lastUsed = 0;
+		std::list<uint32_t>::iterator ramLru, vramLru;
+	};
+
+	struct Request
+	{
+		float priority;
+		uint32_t node;
+	};
+
+	void ReadLoop(std::filesystem::path path);
+	void CollectReads();
+	void Select(const glm::mat4& model, const glm::vec3& eye, float projection);
+	float ScreenSpaceError(uint32_t node, const glm::mat4& model, const glm::vec3& eye, float projection) const;
+	void Want(uint32_t node, float priority);
+	void Touch(uint32_t node);
+	bool IsOnGpu(uint32_t node) const;
+	bool ReserveRam(size_t bytes);
+	bool ReserveVram(size_t bytes);
+	void Upload(uint32_t node);
+	void ReleaseGpu(uint32_t node);
+
+	std::vector<ChunkNode> mNodes;
+	std::vector<ChunkState> mStates;
+	std::list<uint32_t> mRamLru, mVramLru;	// most recently used at the front
+	std::vector<uint32_t> mDrawList;
+	std::vector<Request> mUploads, mReads;
+
+	glm::vec3 mCenter;
+	float mScale;
+	float mErrorThreshold;
+	uint64_t mFrame;
+	ChunkCacheStats mStats;
+
+	// Shared with the reader thread
+	std::thread mReader;
+	std::mutex mMutex;
+	std::condition_variable mWake;
+	std::deque<uint32_t> mReadQueue;
+	std::vector<std::pair<uint32_t, std::vector<char>>> mCompleted;
+	uint64_t mBytesRead;
+	double mReadSeconds;
+	bool mStop;
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <filesystem>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+enum class ExportFormat
+{
+	MeshCache,
+	Gltf,
+	Glb,
+	Ply,
+	Chunks	// out-of-core chunk hierarchy, streamed without loading the whole mesh
+};
+
+struct ConvertOptions
+{
+	std::filesystem::path input;	// a single .obj or a directory searched recursively
+	std::filesystem::path output;	// output directory, mirrors the input layout
+	ExportFormat format = ExportFormat::MeshCache;
+	bool weld = false;
+	float weldEpsilon = 0.0f;
+	bool triangulate = false;
+	bool optimize = false;
+	float simplifyRatio = 1.0f;
+	bool normals = false;		// regenerate vertex normals
+	bool tangents = false;		// also tangents, for meshes with texture coordinates
+	float creaseAngle = 60.0f;
+	size_t chunkTriangles = 1 << 16;
+	size_t chunkMemory = 512ull << 20;	// per job
+	unsigned int jobs = 0;			// 0 picks the hardware concurrency
+	unsigned int queueCapacity = 0;	// 0 picks twice the job count
+};
+
+struct ConvertResult
+{
+	std::filesystem::path source;
+	std::string error;
+	size_t vertices = 0;
+	size_t triangles = 0;
+	size_t outputBytes = 0;
+	double parseMs = 0.0;
+	double processMs = 0.0;
+	double writeMs = 0.0;
+};
+
+// Batch OBJ conversion without a window or GL context. Files are pushed
+// through a bounded queue to a fixed pool of workers, so at most `jobs`
+// meshes are held in memory at any time.
+class Converter
+{
+public:
+	explicit Converter(ConvertOptions options);
+
+	// Returns the number of files that failed
+	int Run();
+	const std::vector<ConvertResult>& GetResults() const;
+	void PrintReport(std::ostream& os) const;
+
+private:
+	ConvertResult Convert(const std::filesystem::path& source) const;
+	ConvertResult BuildChunks(const std::filesystem::path& source) const;
+	std::filesystem::path OutputPath(const std::filesystem::path& source) const;
+
+	ConvertOptions mOptions;
+	std::vector<ConvertResult> mResults;
+	double mWallMs;
+};
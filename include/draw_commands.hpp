@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "worker_pool.hpp"
+
+// Layout consumed by glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand
+{
+	uint32_t count;
+	uint32_t instanceCount;
+	uint32_t firstIndex;
+	int32_t baseVertex;
+	uint32_t baseInstance;	// also the draw ID, indexes the per-object data
+};
+
+static_assert(sizeof(DrawElementsIndirectCommand) == 20);
+
+// A mesh inside the shared vertex and index buffers
+struct MeshRange
+{
+	uint32_t indexCount;
+	uint32_t firstIndex;
+	int32_t baseVertex;
+	glm::vec3 center;	// bounding sphere in model space
+	float radius;
+};
+
+// Bounding sphere around the box of the vertices
+MeshRange MakeMeshRange(std::span<const glm::vec3> vertices, uint32_t indexCount, uint32_t firstIndex, int32_t baseVertex);
+
+struct DrawObject
+{
+	uint32_t mesh;
+	glm::mat4 model;
+};
+
+// Frustum culls a scene and writes one indirect command plus model matrix per
+// visible object, command i reads models[i]. Objects are split across a pool
+// of persistent workers in two passes, a cull pass counts the survivors of
+// every range and an emit pass writes them at their prefix sum offset, so the
+// output is compact and in object order without any locking. GL-free, the
+// renderer uploads the results.
+class DrawCommandBuilder
+{
+public:
+	explicit DrawCommandBuilder(unsigned int threads = 0);	// 0 picks the hardware concurrency
+
+	DrawCommandBuilder(const DrawCommandBuilder&) = delete;
+	DrawCommandBuilder& operator=(const DrawCommandBuilder&) = delete;
+
+	void Build(std::span<const MeshRange> meshes, std::span<const DrawObject> objects, const glm::mat4& viewProjection);
+
+	std::span<const DrawElementsIndirectCommand> GetCommands() const;
+	std::span<const glm::mat4> GetModels() const;
+	unsigned int GetThreadCount() const;
+
+private:
+	enum class Pass
+	{
+		Cull,
+		Emit
+	};
+
+	void RunPass(Pass pass, unsigned int worker, unsigned int active);
+	bool IsVisible(const DrawObject& object) const;
+
+	WorkerPool mPool;
+
+	std::span<const MeshRange> mMeshes;
+	std::span<const DrawObject> mObjects;
+	glm::vec4 mPlanes[6];
+
+	// Sized to the largest scene seen, so steady state frames do not allocate
+	std::vector<uint32_t> mVisible;
+	std::vector<uint32_t> mCounts, mOffsets;
+	std::vector<DrawElementsIndirectCommand> mCommands;
+	std::vector<glm::mat4> mModels;
+	size_t mCount;
+};
@@ -1,13 +1,25 @@
 #pragma once
+#include <string>
 #include "glm/fwd.hpp"
 #include "glm/gtc/type_ptr.hpp"
 
 struct GLFWwindow;
 
+struct EngineOptions
+{
+	std::string meshPath = "assets/meshes/cube.obj";	// .obj, .meshbin or an out-of-core chunk directory
+	size_t ramBudget = 1024ull << 20;					// out-of-core chunk cache budgets
+	size_t vramBudget = 512ull << 20;
+	unsigned int gridSize = 0;							// draws gridSize^3 copies of the mesh through the scene renderer
+	bool indirect = true;								// use multi-draw indirect when GL 4.3 is available
+	bool normals = false;								// generate normals and draw the single mesh path shaded
+	float creaseAngle = 60.0f;							// degrees, sharper edges keep split normals
+};
+
 class Engine 
 {
 public:
-	Engine(int width, int height);
+	Engine(int width, int height, EngineOptions options = {});
 	~Engine();
 	
 	void Run();
@@ -16,8 +28,10 @@ private:
 	void Init();
 	void InitCallbacks();
 	void ImGuiFrame();
+	void AllocationsPanel();
 	void Render();
 
 	GLFWwindow *mWindow;
 	int mWidth, mHeight;
+	EngineOptions mOptions;
 };
\ No newline at end of file
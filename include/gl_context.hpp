@@ -0,0 +1,8 @@
+#pragma once
+
+struct GLFWwindow;
+
+// Creates a window with a current context and loads GL through glad. With
+// preferModern a 4.3 core context is tried first, which enables the
+// multi-draw indirect path, and 3.3 is the fallback. glfw must be initialised.
+GLFWwindow* CreateGLWindow(int width, int height, const char* title, bool visible, bool preferModern);
@@ -1,22 +1,51 @@
 #pragma once
 
+#include <memory>
+#include <memory_resource>
 #include <vector>
 #include <glad/gl.h>
 #include <glm/gtc/quaternion.hpp>
 
+// CPU side geometry, shared by the viewer and the offline processing stages.
+// The loaders size a monotonic arena up front and allocate every array from
+// it, so a load is one allocation that is released together with the data.
+// The arena is sized for what the file holds, stages that add vertices or
+// attributes later take one more block per grown array from it.
+struct MeshData
+{
+	MeshData();
+	explicit MeshData(size_t arenaBytes);
+	MeshData(MeshData&&) = default;
+	MeshData& operator=(MeshData&&) = delete;	// the arrays would keep pointing into the old arena
+
+	std::shared_ptr<std::pmr::memory_resource> arena;
+	std::pmr::vector<glm::vec3> vertices;
+	std::pmr::vector<unsigned int> indices;
+	std::pmr::vector<unsigned int> faceSizes;	// corners per face, empty when every face is a triangle
+
+	// Optional attributes, either empty or one per vertex
+	std::pmr::vector<glm::vec2> texCoords;
+	std::pmr::vector<glm::vec3> normals;
+	std::pmr::vector<glm::vec4> tangents;		// w is the bitangent sign
+	std::pmr::vector<unsigned int> smoothingGroups;	// one per face, 0 is flat, empty smooths everything
+};
 
 class Mesh 
 {
 public:
 	Mesh();
 	void Load(const char *name);
+	void Upload(const MeshData& data);
 	GLuint GetVAO() const;
 	GLsizei GetIndicesCount() const;
 
+	static MeshData Parse(const char *name);
+	static MeshData Prepare(const char *name);	// parsed, triangulated and fitted into the unit cube
+
 private:
-	void Center(std::vector<glm::vec3>& vertices) const;
-	void Normalize(std::vector<glm::vec3>& vertices) const;
+	static void Center(std::pmr::vector<glm::vec3>& vertices);
+	static void Normalize(std::pmr::vector<glm::vec3>& vertices);
 	glm::quat orientation;
 	GLuint mVAO;
 	GLsizei mCount;
-};
\ No newline at end of file
+};
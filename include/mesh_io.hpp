@@ -0,0 +1,18 @@
+#pragma once
+
+#include <filesystem>
+
+#include "mesh.hpp"
+
+// Binary mesh cache, a small header followed by the raw MeshData arrays
+// so that it can be read straight back without parsing.
+bool IsMeshCache(const std::filesystem::path& path);
+MeshData ReadMeshCache(const std::filesystem::path& path);
+void WriteMeshCache(const std::filesystem::path& path, const MeshData& data);
+
+// glTF 2.0, either a .gltf with a sibling .bin or a single .glb, triangles only.
+// Normals, tangents and texture coordinates are written when present.
+void WriteGltf(const std::filesystem::path& path, const MeshData& data, bool binary);
+
+// Binary little endian PLY, polygons are written as is, with normals and texture coordinates when present
+void WritePly(const std::filesystem::path& path, const MeshData& data);
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+#include "mesh.hpp"
+
+// Processing stages that run on the CPU side geometry after Mesh::Parse.
+// Every stage works in place, and the stages that need triangles
+// triangulate the mesh first.
+
+// Fan triangulate polygon faces, faces with less than 3 corners are dropped
+void Triangulate(MeshData& data);
+
+// Merge vertices that fall in the same epsilon sized cell, 0 only merges exact duplicates.
+// Vertices with different texture coordinates are kept apart, normals and tangents are dropped.
+void WeldVertices(MeshData& data, float epsilon = 0.0f);
+
+// Reorder triangles for the post transform cache (Forsyth) and vertices for fetch locality
+void OptimizeVertexCache(MeshData& data);
+
+// Vertex clustering simplification down to roughly ratio * triangle count, keeps positions only
+void Simplify(MeshData& data, float ratio);
+
+// Bits of a coordinate for exact matching, adding 0 folds -0.0f into 0.0f
+inline uint32_t ExactBits(float value)
+{
+	return std::bit_cast<uint32_t>(value + 0.0f);
+}
+
+// FNV style mix of three coordinates, for hashing positions and grid cells
+inline size_t HashCoordinates(uint64_t x, uint64_t y, uint64_t z)
+{
+	uint64_t h = 14695981039346656037ull;
+	for (auto v : { x, y, z })
+	{
+		h ^= v;
+		h *= 1099511628211ull;
+	}
+	return static_cast<size_t>(h ^ (h >> 32));
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include <glm/glm.hpp>
+
+// Allocation free helpers for the few OBJ records we read, shared by
+// Mesh::Parse and the streaming ChunkBuilder.
+
+// Returns the text after the keyword if the line is a record of that type, nullptr otherwise
+inline const char* MatchRecord(const std::string& line, std::string_view keyword)
+{
+	const char* s = line.c_str();
+	while (*s == ' ' || *s == '\t')
+	{
+		++s;
+	}
+	if (std::strncmp(s, keyword.data(), keyword.size()) != 0)
+	{
+		return nullptr;
+	}
+	s += keyword.size();
+	return *s == ' ' || *s == '\t' ? s + 1 : nullptr;
+}
+
+inline glm::vec3 ParseVertex(const char* s)
+{
+	char* end{};
+	glm::vec3 v{};
+	v.x = std::strtof(s, &end);
+	v.y = std::strtof(end, &end);
+	v.z = std::strtof(end, &end);
+	return v;
+}
+
+inline glm::vec2 ParseTexCoord(const char* s)
+{
+	char* end{};
+	glm::vec2 t{};
+	t.x = std::strtof(s, &end);
+	t.y = std::strtof(end, &end);
+	return t;
+}
+
+// "s off" and "s 0" both turn smoothing off
+inline unsigned int ParseSmoothingGroup(const char* s)
+{
+	return static_cast<unsigned int>(std::strtoul(s, nullptr, 10));
+}
+
+inline constexpr uint64_t kNoTexCoord = UINT64_MAX;
+
+// 1 based or relative OBJ index to 0 based, out of range indices come back >= count
+inline uint64_t ResolveIndex(long long id, uint64_t count)
+{
+	const auto index = id < 0 ? static_cast<long long>(count) + id : id - 1;
+	return index < 0 ? UINT64_MAX : static_cast<uint64_t>(index);
+}
+
+// Calls corner(index, texCoord) with the 0 based position and texture
+// coordinate index of every corner of an "f" record, negative OBJ indices are
+// relative to the records read so far. texCoord is kNoTexCoord when the corner
+// has none or texCoordCount is 0, which skips them. Normal indices are skipped.
+template <typename F>
+void ParseFace(const char* s, uint64_t vertexCount, uint64_t texCoordCount, F&& corner)
+{
+	while (*s)
+	{
+		if (std::isspace(static_cast<unsigned char>(*s)))
+		{
+			++s;
+			continue;
+		}
+
+		char* end{};
+		const auto index = ResolveIndex(std::strtoll(s, &end, 10), vertexCount);
+		if (end == s || index >= vertexCount)
+		{
+			throw std::runtime_error("Mesh face references a missing vertex");
+		}
+		s = end;
+
+		auto texCoord = kNoTexCoord;
+		if (*s == '/' && texCoordCount > 0 && s[1] != '/')
+		{
+			texCoord = ResolveIndex(std::strtoll(s + 1, &end, 10), texCoordCount);
+			if (end == s + 1 || texCoord >= texCoordCount)
+			{
+				throw std::runtime_error("Mesh face references a missing texture coordinate");
+			}
+			s = end;
+		}
+		corner(index, texCoord);
+
+		while (*s && !std::isspace(static_cast<unsigned char>(*s)))
+		{
+			++s;
+		}
+	}
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+#include "draw_commands.hpp"
+#include "mesh.hpp"
+#include "shader.hpp"
+
+struct SceneStats
+{
+	unsigned int objects = 0;
+	unsigned int visible = 0;
+	unsigned int drawCalls = 0;
+	uint64_t triangles = 0;
+	double buildMs = 0.0;	// culling and command generation
+	double submitMs = 0.0;	// buffer uploads and draw calls, CPU side only
+};
+
+// Draws many instances of many meshes out of one shared vertex and index buffer.
+// On GL 4.3 the whole scene is a single glMultiDrawElementsIndirect, every
+// command's baseInstance feeds a per-instance draw ID attribute that indexes
+// an SSBO of model matrices. On 3.3 the same commands are replayed one
+// glDrawElementsBaseVertex at a time.
+class SceneRenderer
+{
+public:
+	explicit SceneRenderer(unsigned int threads = 0);
+	~SceneRenderer();
+
+	SceneRenderer(const SceneRenderer&) = delete;
+	SceneRenderer& operator=(const SceneRenderer&) = delete;
+
+	static bool IsIndirectSupported();
+
+	// Geometry must be triangulated, the buffers are uploaded on the next Draw
+	uint32_t AddMesh(const MeshData& data);
+	void Draw(std::span<const DrawObject> objects, const glm::mat4& viewProjection);
+
+	bool IsIndirect() const;
+	void SetIndirect(bool indirect);	// ignored without GL 4.3
+	unsigned int GetThreadCount() const;
+	const SceneStats& GetStats() const;
+
+private:
+	void UploadGeometry();
+	void ReserveObjects(size_t count);
+	void DrawIndirect(std::span<const DrawElementsIndirectCommand> commands, std::span<const glm::mat4> models, const glm::mat4& viewProjection);
+	void DrawDirect(std::span<const DrawElementsIndirectCommand> commands, std::span<const glm::mat4> models, const glm::mat4& viewProjection);
+
+	std::vector<glm::vec3> mVertices;
+	std::vector<unsigned int> mIndices;
+	std::vector<MeshRange> mMeshes;
+	bool mDirty;
+
+	DrawCommandBuilder mBuilder;
+	Shader mDirectShader;
+	std::optional<Shader> mIndirectShader;
+	bool mIndirect;
+
+	GLuint mVAO, mVBO, mEBO;
+	GLuint mCommandBuffer, mObjectBuffer, mDrawIdBuffer;
+	size_t mObjectCapacity;
+
+	SceneStats mStats;
+};
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "mesh.hpp"
+#include "worker_pool.hpp"
+
+struct TangentSpaceOptions
+{
+	float creaseAngle = 60.0f;	// degrees, faces meeting at a sharper angle are not smoothed together
+	bool tangents = false;		// also generate tangents, needs texture coordinates
+	unsigned int threads = 0;	// 0 picks the hardware concurrency
+};
+
+// Vertex normals and tangents for a triangulated mesh, in parallel.
+//
+// Every corner's normal is the corner angle weighted sum of the face normals
+// around its position, over the faces in the same smoothing group that meet
+// the corner's face within the crease angle. Smoothing group 0 is flat and
+// texture seams do not break smoothing. Vertices whose corners end up with
+// different normals are split.
+//
+// Tangents follow MikkTSpace: face tangents from the texture coordinate
+// gradients are projected into the plane of the vertex normal and summed with
+// the projected corner angle as weight, and vertices shared by mirrored and
+// unmirrored faces are split, w holds the bitangent sign.
+//
+// Splits are computed as index remaps first, so every per vertex array of
+// the mesh is reallocated once, at its final size.
+//
+// The generator keeps its adjacency and a pool of worker threads, so after
+// editing some positions Update only recomputes the faces and vertices around
+// them. Splits are not redone, run Generate again after changes that should
+// open or close creases.
+class TangentSpaceGenerator
+{
+public:
+	explicit TangentSpaceGenerator(TangentSpaceOptions options = {});
+
+	TangentSpaceGenerator(const TangentSpaceGenerator&) = delete;
+	TangentSpaceGenerator& operator=(const TangentSpaceGenerator&) = delete;
+
+	void Generate(MeshData& data);
+
+	// changedVertices had their positions edited, copies of the same position
+	// (texture seams and creases) are moved along with them
+	void Update(MeshData& data, std::span<const unsigned int> changedVertices);
+
+private:
+	// Corners grouped by a key, a CSR table sorted by corner within every key
+	struct CornerTable
+	{
+		std::vector<unsigned int> offsets;
+		std::vector<unsigned int> corners;
+
+		std::span<const unsigned int> Get(size_t key) const;
+	};
+
+	void BuildCornerTable(CornerTable& table, std::span<const unsigned int> keys, size_t keyCount) const;
+	void SharePositions(const MeshData& data);
+	void ComputeFace(const MeshData& data, size_t face);
+	bool IsSmooth(const MeshData& data, size_t face, size_t other) const;
+	glm::vec3 NormalAt(const MeshData& data, unsigned int corner) const;
+	void PositionNormals(const MeshData& data, size_t position, std::span<glm::vec3> cornerNormals) const;
+	glm::vec4 TangentAt(const MeshData& data, unsigned int vertex) const;
+
+	// Gives every distinct corner value of a vertex its own vertex. Writes the
+	// new index of every corner and, per new vertex, the vertex it copies.
+	template <typename T>
+	void SplitVertices(std::span<const unsigned int> indices, size_t vertexCount, std::span<const T> cornerValues,
+		std::vector<unsigned int>& splitIndices, std::vector<unsigned int>& source);
+
+	template <typename F>
+	void ParallelFor(size_t count, F&& body) const;
+
+	TangentSpaceOptions mOptions;
+	float mCosCrease;
+	mutable WorkerPool mPool;	// running loops does not change the generator
+
+	std::vector<unsigned int> mPositionOf;	// lowest vertex with the same position
+	std::vector<unsigned int> mCornerOf;	// any corner using the vertex
+	std::vector<glm::vec3> mFaceNormals;
+	std::vector<glm::vec3> mCornerAngles;
+	std::vector<glm::vec4> mFaceTangents;	// w is the orientation, 0 for degenerate texture coordinates
+	CornerTable mByPosition, mByVertex;
+
+	// Update bookkeeping, an entry is marked when it holds the current stamp
+	std::vector<unsigned int> mPositionStamps, mFaceStamps, mVertexStamps;
+	unsigned int mStamp;
+};
+
+// One shot helpers for the converter and viewer
+void GenerateNormals(MeshData& data, float creaseAngle = 60.0f, unsigned int threads = 0);
+void GenerateTangents(MeshData& data, float creaseAngle = 60.0f, unsigned int threads = 0);
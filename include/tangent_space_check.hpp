@@ -0,0 +1,24 @@
+#pragma once
+
+#include <functional>
+#include <iosfwd>
+#include <string_view>
+
+#include "mesh.hpp"
+
+// Self check of TangentSpaceGenerator against a brute force reference that
+// evaluates the definitions directly, corner by corner, without the
+// generator's tables, hashing or vertex splits.
+//
+// For every thread count from 1 up to maxThreads (doubling) it checks that
+// Generate matches the reference and the single threaded result bit for bit,
+// and that Update after a small edit of some positions matches the reference
+// for the vertices Generate made. Tangents are checked too when the mesh has
+// texture coordinates. load must return the same mesh on every call. Returns
+// false and reports to os on any mismatch.
+bool CheckTangentSpace(std::string_view name, const std::function<MeshData()>& load, float creaseAngle,
+	unsigned int maxThreads, std::ostream& os);
+
+// UV sphere with texture seams, a mirrored texture half, two smoothing groups
+// meeting at the equator, a flat band and degenerate triangles at the poles
+MeshData MakeCheckSphere(unsigned int rings);
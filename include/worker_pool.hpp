@@ -0,0 +1,81 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Persistent worker threads for data parallel loops. The calling thread is
+// worker 0 and takes part in every run, the others sleep between runs. Only
+// one thread at a time may start runs on a pool.
+class WorkerPool
+{
+public:
+	explicit WorkerPool(unsigned int threads = 0);	// 0 picks the hardware concurrency
+	~WorkerPool();
+
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	unsigned int GetThreadCount() const;
+
+	// Workers worth waking for count items. Below minItemsPerWorker items per
+	// worker the wake up costs more than it saves.
+	unsigned int GetActiveCount(size_t count, size_t minItemsPerWorker) const;
+
+	// Calls task(worker, active) on workers 0 to active - 1 and returns when
+	// all of them are done
+	template <typename F>
+	void Run(unsigned int active, F&& task);
+
+	// Calls body(first, last) on one contiguous range of [0, count) per worker
+	template <typename F>
+	void ParallelFor(size_t count, size_t minItemsPerWorker, F&& body);
+
+private:
+	using Task = void (*)(void* body, unsigned int worker, unsigned int active);
+
+	void Dispatch(Task task, void* body, unsigned int active);
+	void WorkerLoop(unsigned int worker);
+
+	std::vector<std::thread> mWorkers;
+
+	// The task and the number of workers taking part are published together
+	// under mMutex, workers that sat out earlier runs may wake at any time
+	std::mutex mMutex;
+	std::condition_variable mStart, mDone;
+	Task mTask;
+	void* mBody;
+	uint64_t mGeneration;
+	unsigned int mPending;
+	unsigned int mActive;
+	bool mStop;
+};
+
+template <typename F>
+void WorkerPool::Run(unsigned int active, F&& task)
+{
+	active = std::clamp(active, 1u, GetThreadCount());
+	if (active == 1)
+	{
+		task(0u, 1u);
+		return;
+	}
+
+	using Body = std::remove_reference_t<F>;
+	Dispatch([](void* body, unsigned int worker, unsigned int active) { (*static_cast<Body*>(body))(worker, active); },
+		const_cast<void*>(static_cast<const void*>(std::addressof(task))), active);
+}
+
+template <typename F>
+void WorkerPool::ParallelFor(size_t count, size_t minItemsPerWorker, F&& body)
+{
+	Run(GetActiveCount(count, minItemsPerWorker), [&](unsigned int worker, unsigned int active)
+	{
+		body(count * worker / active, count * (worker + 1) / active);
+	});
+}
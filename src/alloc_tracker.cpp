@@ -0,0 +1,256 @@
+#include "alloc_tracker.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+static constexpr size_t kSubsystemCount = static_cast<size_t>(AllocSubsystem::Count);
+static constexpr size_t kTotal = kSubsystemCount;
+
+struct AtomicCounters
+{
+	std::atomic<uint64_t> count;
+	std::atomic<uint64_t> bytes;
+	std::atomic<uint64_t> liveBytes;
+	std::atomic<uint64_t> peakBytes;
+};
+
+// Zero initialised before any dynamic initialisation, so allocations made by
+// other static constructors are counted as well
+static AtomicCounters gCounters[kSubsystemCount + 1];
+static thread_local AllocSubsystem tSubsystem = AllocSubsystem::Other;
+
+static
+AllocCounters Load(const AtomicCounters& counters)
+{
+	AllocCounters result;
+	result.count = counters.count.load(std::memory_order_relaxed);
+	result.bytes = counters.bytes.load(std::memory_order_relaxed);
+	result.liveBytes = counters.liveBytes.load(std::memory_order_relaxed);
+	result.peakBytes = counters.peakBytes.load(std::memory_order_relaxed);
+	return result;
+}
+
+bool AllocTracker::IsEnabled()
+{
+#ifdef OBJ_LOADER_TRACK_ALLOCATIONS
+	return true;
+#else
+	return false;
+#endif
+}
+
+const char* AllocTracker::GetName(AllocSubsystem subsystem)
+{
+	switch (subsystem)
+	{
+	case AllocSubsystem::MeshLoad: return "mesh load";
+	case AllocSubsystem::MeshProcessing: return "mesh processing";
+	case AllocSubsystem::Export: return "export";
+	case AllocSubsystem::Chunks: return "chunks";
+	case AllocSubsystem::Render: return "render";
+	default: return "other";
+	}
+}
+
+AllocCounters AllocTracker::Get(AllocSubsystem subsystem)
+{
+	return Load(gCounters[static_cast<size_t>(subsystem)]);
+}
+
+AllocCounters AllocTracker::GetTotal()
+{
+	return Load(gCounters[kTotal]);
+}
+
+AllocScope::AllocScope(AllocSubsystem subsystem) :
+	mPrevious{ tSubsystem }
+{
+	tSubsystem = subsystem;
+}
+
+AllocScope::~AllocScope()
+{
+	tSubsystem = mPrevious;
+}
+
+#ifdef OBJ_LOADER_TRACK_ALLOCATIONS
+
+// Every block carries its size and subsystem in front of the pointer handed out,
+// and where malloc put it, which over-aligned blocks start after
+struct alignas(alignof(std::max_align_t)) BlockHeader
+{
+	void* block;
+	size_t size;
+	AllocSubsystem subsystem;
+};
+
+static
+void Charge(AtomicCounters& counters, size_t size)
+{
+	counters.count.fetch_add(1, std::memory_order_relaxed);
+	counters.bytes.fetch_add(size, std::memory_order_relaxed);
+
+	const auto live = counters.liveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+	auto peak = counters.peakBytes.load(std::memory_order_relaxed);
+	while (live > peak && !counters.peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+	{
+	}
+}
+
+static
+void* TrackedAlloc(size_t size, size_t alignment = alignof(BlockHeader))
+{
+	alignment = std::max(alignment, alignof(BlockHeader));
+	auto* block = static_cast<char*>(std::malloc(sizeof(BlockHeader) + size + alignment - alignof(BlockHeader)));
+	if (!block)
+	{
+		return nullptr;
+	}
+
+	// malloc already aligns to max_align_t, only larger alignments move the header
+	const auto address = reinterpret_cast<uintptr_t>(block + sizeof(BlockHeader));
+	const auto aligned = (address + alignment - 1) & ~uintptr_t{ alignment - 1 };
+	auto* header = reinterpret_cast<BlockHeader*>(aligned) - 1;
+
+	header->block = block;
+	header->size = size;
+	header->subsystem = tSubsystem;
+	Charge(gCounters[static_cast<size_t>(header->subsystem)], size);
+	Charge(gCounters[kTotal], size);
+	return header + 1;
+}
+
+static
+void TrackedFree(void* ptr)
+{
+	if (!ptr)
+	{
+		return;
+	}
+
+	auto* header = static_cast<BlockHeader*>(ptr) - 1;
+	gCounters[static_cast<size_t>(header->subsystem)].liveBytes.fetch_sub(header->size, std::memory_order_relaxed);
+	gCounters[kTotal].liveBytes.fetch_sub(header->size, std::memory_order_relaxed);
+	std::free(header->block);
+}
+
+void* operator new(std::size_t size)
+{
+	if (auto* ptr = TrackedAlloc(size))
+	{
+		return ptr;
+	}
+	throw std::bad_alloc{};
+}
+
+void* operator new[](std::size_t size)
+{
+	if (auto* ptr = TrackedAlloc(size))
+	{
+		return ptr;
+	}
+	throw std::bad_alloc{};
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+	return TrackedAlloc(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+	return TrackedAlloc(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+	TrackedFree(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+	TrackedFree(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+	TrackedFree(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept
+{
+	TrackedFree(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+	TrackedFree(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{
+	TrackedFree(ptr);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+	if (auto* ptr = TrackedAlloc(size, static_cast<size_t>(alignment)))
+	{
+		return ptr;
+	}
+	throw std::bad_alloc{};
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment)
+{
+	if (auto* ptr = TrackedAlloc(size, static_cast<size_t>(alignment)))
+	{
+		return ptr;
+	}
+	throw std::bad_alloc{};
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	return TrackedAlloc(size, static_cast<size_t>(alignment));
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	return TrackedAlloc(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept
+{
+	TrackedFree(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t) noexcept
+{
+	TrackedFree(ptr);
+}
+
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept
+{
+	TrackedFree(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept
+{
+	TrackedFree(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept
+{
+	TrackedFree(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept
+{
+	TrackedFree(ptr);
+}
+
+#endif
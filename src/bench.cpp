@@ -0,0 +1,325 @@
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <glad/gl.h>
+#include <GLFW/glfw3.h>
+#include <glm/ext/matrix_clip_space.hpp>
+#include <glm/ext/matrix_transform.hpp>
+
+#include "alloc_tracker.hpp"
+#include "draw_commands.hpp"
+#include "gl_context.hpp"
+#include "mesh.hpp"
+#include "scene_renderer.hpp"
+#include "tangent_space.hpp"
+#include "tangent_space_check.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+struct BenchOptions
+{
+	std::string meshPath = "assets/meshes/cube.obj";
+	size_t objects = 10000;
+	unsigned int frames = 100;
+	unsigned int threads = 0;	// 0 picks the hardware concurrency
+	bool cpuOnly = false;
+	bool tangentSpace = false;
+	bool verify = false;
+};
+
+static
+void PrintUsage()
+{
+	std::cerr <<
+		"usage: obj_bench [mesh] [options]\n"
+		"  --objects <n>                   scene objects (default 10000)\n"
+		"  --frames <n>                    timed frames per run (default 100)\n"
+		"  --threads <n>                   command generation threads (default: all cores)\n"
+		"  --cpu-only                      only time command generation, no GL context\n"
+		"  --tangent-space                 also time normal and tangent generation on the mesh\n"
+		"  --verify                        check normal and tangent generation against a brute force\n"
+		"                                  reference on the mesh and a test sphere, then exit\n"
+		"Run headless under software GL with e.g. LIBGL_ALWAYS_SOFTWARE=1 xvfb-run obj_bench\n";
+}
+
+// Objects scattered in a box around the origin, roughly three quarters of them in view
+static
+std::vector<DrawObject> MakeScene(uint32_t mesh, size_t count)
+{
+	std::mt19937 random{ 1234 };
+	std::uniform_real_distribution<float> position{ -20.0f, 20.0f };
+	std::uniform_real_distribution<float> size{ 0.2f, 0.6f };
+
+	std::vector<DrawObject> objects(count);
+	for (auto& object : objects)
+	{
+		const glm::vec3 offset{ position(random), position(random), position(random) };
+		object.mesh = mesh;
+		object.model = glm::scale(glm::translate(glm::mat4(1.0f), offset), glm::vec3(size(random)));
+	}
+	return objects;
+}
+
+static
+glm::mat4 MakeViewProjection()
+{
+	const auto projection = glm::perspective(glm::radians(60.0f), 4.0f / 3.0f, 0.1f, 100.0f);
+	const auto view = glm::lookAt(glm::vec3(0.0f, 0.0f, 30.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	return projection * view;
+}
+
+static
+uint64_t AllocationCount()
+{
+	return AllocTracker::GetTotal().count;
+}
+
+static
+void PrintRow(std::string_view name, double frameMs, double buildMs, double submitMs, unsigned int drawCalls, uint64_t allocations, unsigned int frames)
+{
+	std::cout << std::left << std::setw(28) << name << std::right << std::fixed << std::setprecision(3)
+		<< std::setw(12) << frameMs
+		<< std::setw(12) << buildMs
+		<< std::setw(12) << submitMs
+		<< std::setw(12) << drawCalls;
+	if (AllocTracker::IsEnabled())
+	{
+		std::cout << std::setw(14) << std::setprecision(1) << static_cast<double>(allocations) / frames;
+	}
+	std::cout << "\n";
+}
+
+static
+void PrintHeader()
+{
+	std::cout << std::left << std::setw(28) << "run" << std::right
+		<< std::setw(12) << "frame ms"
+		<< std::setw(12) << "build ms"
+		<< std::setw(12) << "submit ms"
+		<< std::setw(12) << "draw calls";
+	if (AllocTracker::IsEnabled())
+	{
+		std::cout << std::setw(14) << "allocs/frame";
+	}
+	std::cout << "\n";
+}
+
+static
+void BenchCommands(const std::vector<MeshRange>& meshes, const std::vector<DrawObject>& objects, const BenchOptions& options)
+{
+	const auto viewProjection = MakeViewProjection();
+	const unsigned int maxThreads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+
+	for (unsigned int threads = 1; ; threads = std::min(threads * 2, maxThreads))
+	{
+		DrawCommandBuilder builder{ threads };
+		builder.Build(meshes, objects, viewProjection);
+
+		const auto allocations = AllocationCount();
+		const auto start = Clock::now();
+		for (unsigned int frame = 0; frame < options.frames; ++frame)
+		{
+			builder.Build(meshes, objects, viewProjection);
+		}
+		const std::chrono::duration<double, std::milli> elapsed = Clock::now() - start;
+		const double buildMs = elapsed.count() / options.frames;
+
+		const auto name = "commands, " + std::to_string(threads) + " thread" + (threads > 1 ? "s" : "");
+		PrintRow(name, buildMs, buildMs, 0.0, 0, AllocationCount() - allocations, options.frames);
+
+		if (threads == maxThreads)
+		{
+			std::cout << builder.GetCommands().size() << " of " << objects.size() << " objects visible\n";
+			break;
+		}
+	}
+}
+
+// Normals, plus tangents when the mesh has texture coordinates, on a fresh copy every run
+static
+void BenchTangentSpace(const BenchOptions& options)
+{
+	const unsigned int maxThreads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+
+	std::cout << "\n";
+	for (unsigned int threads = 1; ; threads = std::min(threads * 2, maxThreads))
+	{
+		auto data = Mesh::Prepare(options.meshPath.c_str());
+		const bool tangents = !data.texCoords.empty();
+
+		const auto start = Clock::now();
+		TangentSpaceGenerator{ TangentSpaceOptions{ 60.0f, tangents, threads } }.Generate(data);
+		const std::chrono::duration<double, std::milli> elapsed = Clock::now() - start;
+
+		std::cout << (tangents ? "normals and tangents, " : "normals, ") << threads << " thread" << (threads > 1 ? "s" : "")
+			<< ": " << std::fixed << std::setprecision(3) << elapsed.count() << " ms, "
+			<< data.vertices.size() << " vertices\n";
+
+		if (threads == maxThreads)
+		{
+			break;
+		}
+	}
+}
+
+// At least 4 threads even on small machines, so the parallel paths always run
+static
+bool Verify(const BenchOptions& options)
+{
+	const unsigned int maxThreads = options.threads ? options.threads : std::max(4u, std::thread::hardware_concurrency());
+	const auto& path = options.meshPath;
+
+	bool ok = CheckTangentSpace("test sphere", [] { return MakeCheckSphere(64); }, 60.0f, maxThreads, std::cout);
+	ok = CheckTangentSpace(path, [&path] { return Mesh::Prepare(path.c_str()); }, 60.0f, maxThreads, std::cout) && ok;
+
+	std::cout << (ok ? "all checks passed\n" : "some checks FAILED\n");
+	return ok;
+}
+
+static
+void BenchRender(SceneRenderer& scene, const std::vector<DrawObject>& objects, bool indirect, const BenchOptions& options)
+{
+	const auto viewProjection = MakeViewProjection();
+	scene.SetIndirect(indirect);
+
+	// Warm up, the first frames upload the geometry and grow the buffers
+	for (int frame = 0; frame < 3; ++frame)
+	{
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		scene.Draw(objects, viewProjection);
+	}
+	glFinish();
+
+	double buildMs = 0.0, submitMs = 0.0;
+	const auto allocations = AllocationCount();
+	const auto start = Clock::now();
+	for (unsigned int frame = 0; frame < options.frames; ++frame)
+	{
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		scene.Draw(objects, viewProjection);
+		glFinish();
+
+		buildMs += scene.GetStats().buildMs;
+		submitMs += scene.GetStats().submitMs;
+	}
+	const std::chrono::duration<double, std::milli> elapsed = Clock::now() - start;
+
+	PrintRow(indirect ? "multi-draw indirect" : "glDrawElementsBaseVertex",
+		elapsed.count() / options.frames, buildMs / options.frames, submitMs / options.frames,
+		scene.GetStats().drawCalls, AllocationCount() - allocations, options.frames);
+}
+
+int main(int argc, char** argv)
+{
+	BenchOptions options;
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string_view arg = argv[i];
+		const bool hasValue = i + 1 < argc;
+
+		if (arg == "--objects" && hasValue)
+		{
+			options.objects = std::strtoull(argv[++i], nullptr, 10);
+		}
+		else if (arg == "--frames" && hasValue)
+		{
+			options.frames = std::max(1u, static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10)));
+		}
+		else if (arg == "--threads" && hasValue)
+		{
+			options.threads = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+		}
+		else if (arg == "--cpu-only")
+		{
+			options.cpuOnly = true;
+		}
+		else if (arg == "--tangent-space")
+		{
+			options.tangentSpace = true;
+		}
+		else if (arg == "--verify")
+		{
+			options.verify = true;
+		}
+		else if (!arg.starts_with("--"))
+		{
+			options.meshPath = arg;
+		}
+		else
+		{
+			std::cerr << "Unknown option " << arg << "\n";
+			PrintUsage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	try
+	{
+		if (options.verify)
+		{
+			return Verify(options) ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+
+		AllocScope scope{ AllocSubsystem::Render };
+		const auto data = Mesh::Prepare(options.meshPath.c_str());
+		const auto triangles = data.indices.size() / 3;
+
+		// The same mesh range the renderer builds, without touching GL
+		const std::vector<MeshRange> meshes{ MakeMeshRange(data.vertices, static_cast<uint32_t>(data.indices.size()), 0, 0) };
+		const auto objects = MakeScene(0, options.objects);
+
+		std::cout << options.meshPath << ": " << triangles << " triangles, " << objects.size() << " objects, "
+			<< options.frames << " frames\n\n";
+		PrintHeader();
+		BenchCommands(meshes, objects, options);
+		if (options.tangentSpace)
+		{
+			BenchTangentSpace(options);
+		}
+
+		if (options.cpuOnly)
+		{
+			return EXIT_SUCCESS;
+		}
+
+		if (!glfwInit())
+		{
+			std::cerr << "No display, skipping the GL runs\n";
+			return EXIT_SUCCESS;
+		}
+
+		auto* window = CreateGLWindow(1024, 768, "obj_bench", false, true);
+		std::cout << "\n" << glGetString(GL_RENDERER) << ", GL " << glGetString(GL_VERSION) << "\n";
+		{
+			SceneRenderer scene{ options.threads };
+			scene.AddMesh(data);
+
+			PrintHeader();
+			if (SceneRenderer::IsIndirectSupported())
+			{
+				BenchRender(scene, objects, true, options);
+			}
+			else
+			{
+				std::cout << "GL 4.3 is not available, only the fallback path is timed\n";
+			}
+			BenchRender(scene, objects, false, options);
+		}
+		glfwDestroyWindow(window);
+		glfwTerminate();
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << "\n";
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
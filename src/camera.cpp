@@ -77,6 +77,11 @@ glm::mat4 Camera::GetViewMatrix() const
     return glm::lookAt(eye, eye + front, glm::vec3{ 0.0f, 1.0f, 0.0f });
 }
 
+glm::vec3 Camera::GetPosition() const 
+{
+    return eye;
+}
+
 void Camera::Zoom(float zoom) 
 {
     float distance = glm::length(eye - target);
@@ -0,0 +1,521 @@
+#include "chunk_builder.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <list>
+#include <string>
+
+#include "mesh_processing.hpp"
+#include "obj_records.hpp"
+
+namespace fs = std::filesystem;
+
+static constexpr unsigned int kMaxDepth = 10;
+static constexpr unsigned int kMaxRefineLevels = 8;	// spatial splits of an oversized cell, then file order
+static constexpr size_t kPageVertices = 1 << 16;
+static constexpr size_t kPageBytes = kPageVertices * sizeof(glm::vec3);
+static constexpr size_t kTriangleBytes = 3 * sizeof(glm::vec3);
+
+// Random access to the spilled positions through a small LRU page cache
+class VertexPager
+{
+public:
+	VertexPager(const fs::path& path, size_t budget) :
+		mFile{ path, std::ios::binary },
+		mCapacity{ std::max<size_t>(1, budget / kPageBytes) }
+	{
+		if (!mFile.good())
+		{
+			throw std::runtime_error("Error opening " + path.string());
+		}
+	}
+
+	glm::vec3 Get(uint64_t index)
+	{
+		const auto page = index / kPageVertices;
+		auto it = mPages.find(page);
+		if (it == mPages.end())
+		{
+			if (mPages.size() >= mCapacity)
+			{
+				mPages.erase(mLru.back());
+				mLru.pop_back();
+			}
+
+			std::vector<glm::vec3> vertices(kPageVertices);
+			mFile.seekg(static_cast<std::streamoff>(page * kPageBytes));
+			mFile.read(reinterpret_cast<char*>(vertices.data()), kPageBytes);
+			mFile.clear();	// the last page is usually short
+
+			mLru.push_front(page);
+			it = mPages.emplace(page, Page{ std::move(vertices), mLru.begin() }).first;
+		}
+		else if (it->second.lru != mLru.begin())
+		{
+			mLru.splice(mLru.begin(), mLru, it->second.lru);
+		}
+		return it->second.vertices[index % kPageVertices];
+	}
+
+private:
+	struct Page
+	{
+		std::vector<glm::vec3> vertices;
+		std::list<uint64_t>::iterator lru;
+	};
+
+	std::ifstream mFile;
+	size_t mCapacity;
+	std::unordered_map<uint64_t, Page> mPages;
+	std::list<uint64_t> mLru;
+};
+
+static
+uint64_t SpreadBits(uint64_t v)
+{
+	v &= 0x1fffff;
+	v = (v | v << 32) & 0x1f00000000ffffull;
+	v = (v | v << 16) & 0x1f0000ff0000ffull;
+	v = (v | v << 8) & 0x100f00f00f00f00full;
+	v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+	v = (v | v << 2) & 0x1249249249249249ull;
+	return v;
+}
+
+ChunkBuilder::ChunkBuilder(fs::path source, fs::path output, ChunkBuildOptions options) :
+	mSource{ std::move(source) },
+	mOutput{ std::move(output) },
+	mTemp{ mOutput / "tmp" },
+	mOptions{ options },
+	mStats{},
+	mLower{ FLT_MAX },
+	mUpper{ -FLT_MAX },
+	mCellSize{},
+	mGridDepth{},
+	mSpillBytes{}
+{
+	mOptions.leafTriangles = std::max<size_t>(mOptions.leafTriangles, 1);
+}
+
+ChunkBuildStats ChunkBuilder::Build()
+{
+	fs::create_directories(mTemp);
+	try
+	{
+		ScanVertices();
+		if (mStats.triangles == 0)
+		{
+			throw std::runtime_error("Mesh has no faces");
+		}
+
+		// Surfaces fill roughly 4 of the 8 children of a cell, size the cells for
+		// that. Denser cells are split further when their leaves are built.
+		uint64_t cells = 1;
+		while (mGridDepth < kMaxDepth && mStats.triangles / cells > mOptions.leafTriangles)
+		{
+			++mGridDepth;
+			cells *= 4;
+		}
+
+		const auto size = mUpper - mLower;
+		const float extent = std::max(std::max(size.x, size.y), std::max(size.z, 1e-6f));
+		mCellSize = extent / static_cast<float>(1u << mGridDepth);
+
+		PartitionTriangles();
+		std::sort(mLeafCodes.begin(), mLeafCodes.end());
+		mLeafCodes.erase(std::unique(mLeafCodes.begin(), mLeafCodes.end()), mLeafCodes.end());
+
+		// Both files are written next to the spills and only moved into place
+		// once complete, so a failed build leaves no partial output behind
+		mChunkFile.open(mTemp / kChunkDataFile, std::ios::binary);
+		if (!mChunkFile.good())
+		{
+			throw std::runtime_error("Error opening " + (mTemp / kChunkDataFile).string() + " for writing");
+		}
+
+		MeshData root;
+		BuildNode(0, mLeafCodes.data(), mLeafCodes.data() + mLeafCodes.size(), root);
+		mChunkFile.close();
+		if (mChunkFile.fail())
+		{
+			throw std::runtime_error("Error writing " + (mTemp / kChunkDataFile).string());
+		}
+
+		WriteHierarchy();
+		fs::rename(mTemp / kChunkDataFile, mOutput / kChunkDataFile);
+		fs::rename(mTemp / kChunkHierarchyFile, mOutput / kChunkHierarchyFile);
+	}
+	catch (...)
+	{
+		mChunkFile.close();
+		std::error_code error;
+		fs::remove_all(mTemp, error);
+		throw;
+	}
+	fs::remove_all(mTemp);
+
+	mStats.nodes = mRecords.size();
+	return mStats;
+}
+
+void ChunkBuilder::ScanVertices()
+{
+	std::ifstream ifs{ mSource };
+	if (!ifs.good())
+	{
+		throw std::runtime_error("Error loading mesh");
+	}
+
+	std::ofstream vertices{ mTemp / "vertices.bin", std::ios::binary };
+	std::string line;
+	std::vector<uint64_t> corners;
+
+	const auto addCorner = [&](uint64_t index, uint64_t) { corners.emplace_back(index); };
+	while (std::getline(ifs, line))
+	{
+		if (const char* s = MatchRecord(line, "v"))
+		{
+			const auto v = ParseVertex(s);
+			vertices.write(reinterpret_cast<const char*>(&v), sizeof v);
+			mLower = glm::min(mLower, v);
+			mUpper = glm::max(mUpper, v);
+			++mStats.vertices;
+		}
+		else if (const char* s = MatchRecord(line, "f"))
+		{
+			corners.clear();
+			ParseFace(s, mStats.vertices, 0, addCorner);
+			mStats.triangles += corners.size() >= 3 ? corners.size() - 2 : 0;
+		}
+	}
+}
+
+void ChunkBuilder::PartitionTriangles()
+{
+	VertexPager pager{ mTemp / "vertices.bin", mOptions.memoryBudget / 2 };
+
+	std::ifstream ifs{ mSource };
+	std::string line;
+	std::vector<uint64_t> corners;
+	uint64_t vertexCount = 0;
+
+	const auto maxCell = static_cast<float>((1u << mGridDepth) - 1);
+	const auto cellOf = [&](float value, float lower)
+	{
+		return static_cast<uint64_t>(std::clamp(std::floor((value - lower) / mCellSize), 0.0f, maxCell));
+	};
+
+	const auto addCorner = [&](uint64_t index, uint64_t) { corners.emplace_back(index); };
+	while (std::getline(ifs, line))
+	{
+		if (MatchRecord(line, "v"))
+		{
+			++vertexCount;
+			continue;
+		}
+
+		const char* s = MatchRecord(line, "f");
+		if (!s)
+		{
+			continue;
+		}
+
+		corners.clear();
+		ParseFace(s, vertexCount, 0, addCorner);
+		for (size_t i = 1; i + 1 < corners.size(); ++i)
+		{
+			const glm::vec3 triangle[3] = {
+				pager.Get(corners[0]),
+				pager.Get(corners[i]),
+				pager.Get(corners[i + 1])
+			};
+
+			const auto centroid = (triangle[0] + triangle[1] + triangle[2]) / 3.0f;
+			const auto code =
+				SpreadBits(cellOf(centroid.x, mLower.x)) |
+				SpreadBits(cellOf(centroid.y, mLower.y)) << 1 |
+				SpreadBits(cellOf(centroid.z, mLower.z)) << 2;
+
+			auto& spill = mSpills[code];
+			spill.insert(spill.end(), std::begin(triangle), std::end(triangle));
+			mSpillBytes += kTriangleBytes;
+
+			if (mSpillBytes > mOptions.memoryBudget / 2)
+			{
+				FlushSpills();
+			}
+		}
+	}
+	FlushSpills();
+}
+
+void ChunkBuilder::FlushSpills()
+{
+	for (const auto& [code, triangles] : mSpills)
+	{
+		std::ofstream ofs{ SpillPath(code), std::ios::binary | std::ios::app };
+		ofs.write(reinterpret_cast<const char*>(triangles.data()), triangles.size() * sizeof triangles[0]);
+		if (!ofs.good())
+		{
+			throw std::runtime_error("Error writing " + SpillPath(code).string());
+		}
+		mLeafCodes.emplace_back(code);
+	}
+	mSpills.clear();
+	mSpillBytes = 0;
+}
+
+fs::path ChunkBuilder::SpillPath(uint64_t code) const
+{
+	return mTemp / ("leaf_" + std::to_string(code) + ".bin");
+}
+
+void ChunkBuilder::ReadLeaf(const fs::path& path, MeshData& data) const
+{
+	const auto count = fs::file_size(path) / sizeof(glm::vec3);
+
+	data.vertices.resize(count);
+	std::ifstream ifs{ path, std::ios::binary };
+	ifs.read(reinterpret_cast<char*>(data.vertices.data()), count * sizeof(glm::vec3));
+
+	data.indices.resize(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		data.indices[i] = static_cast<unsigned int>(i);
+	}
+
+	WeldVertices(data);
+}
+
+uint32_t ChunkBuilder::BuildNode(unsigned int level, const uint64_t* first, const uint64_t* last, MeshData& geometry)
+{
+	if (level == mGridDepth)
+	{
+		return BuildCell(level, 0, SpillPath(*first), geometry);
+	}
+
+	// Codes are sorted, so every child owns a contiguous run of them
+	BuildRecord record{};
+	float childError = 0.0f;
+	const unsigned int shift = 3 * (mGridDepth - level - 1);
+	for (auto it = first; it != last;)
+	{
+		const auto octant = (*it >> shift) & 7;
+		const auto end = std::find_if(it, last, [&](uint64_t code) { return ((code >> shift) & 7) != octant; });
+
+		MeshData child;
+		AddChild(BuildNode(level + 1, it, end, child), child, record, childError, geometry);
+		it = end;
+	}
+	return FinishNode(std::move(record), geometry, childError, true);
+}
+
+uint32_t ChunkBuilder::BuildCell(unsigned int level, unsigned int refined, const fs::path& path, MeshData& geometry)
+{
+	// A leaf is read whole, so it has to stay within the chunk size
+	if (fs::file_size(path) / kTriangleBytes <= mOptions.leafTriangles)
+	{
+		ReadLeaf(path, geometry);
+		fs::remove(path);
+		++mStats.leaves;
+		mStats.depth = std::max(mStats.depth, level);
+		return FinishNode(BuildRecord{}, geometry, 0.0f, false);
+	}
+
+	BuildRecord record{};
+	float childError = 0.0f;
+	for (const auto& childPath : SplitCell(path, refined < kMaxRefineLevels))
+	{
+		MeshData child;
+		AddChild(BuildCell(level + 1, refined + 1, childPath, child), child, record, childError, geometry);
+	}
+	return FinishNode(std::move(record), geometry, childError, true);
+}
+
+// Streams the triangles of an oversized cell into up to 8 child files, by
+// octant around the middle of their centroids. Cells whose centroids all
+// coincide, or that are still too large after kMaxRefineLevels splits, are
+// cut into 8 runs in file order instead, which always shrinks them.
+std::vector<fs::path> ChunkBuilder::SplitCell(const fs::path& path, bool spatial) const
+{
+	constexpr size_t kBlockTriangles = kPageVertices / 3;
+	std::vector<glm::vec3> block(kBlockTriangles * 3);
+	const auto triangles = fs::file_size(path) / kTriangleBytes;
+
+	std::ifstream ifs{ path, std::ios::binary };
+	const auto readBlock = [&]
+	{
+		ifs.read(reinterpret_cast<char*>(block.data()), block.size() * sizeof block[0]);
+		return static_cast<size_t>(ifs.gcount()) / kTriangleBytes;
+	};
+	const auto centroid = [&](size_t i) { return (block[i * 3] + block[i * 3 + 1] + block[i * 3 + 2]) / 3.0f; };
+
+	glm::vec3 lower{ FLT_MAX }, upper{ -FLT_MAX };
+	if (spatial)
+	{
+		for (size_t count; (count = readBlock()) > 0;)
+		{
+			for (size_t i = 0; i < count; ++i)
+			{
+				lower = glm::min(lower, centroid(i));
+				upper = glm::max(upper, centroid(i));
+			}
+		}
+		spatial = lower != upper;
+
+		ifs.clear();
+		ifs.seekg(0);
+	}
+
+	const auto middle = (lower + upper) * 0.5f;
+	const auto run = (triangles + 7) / 8;
+	std::ofstream children[8];
+	std::vector<fs::path> paths(8);
+	uint64_t triangle = 0;
+	for (size_t count; (count = readBlock()) > 0;)
+	{
+		for (size_t i = 0; i < count; ++i, ++triangle)
+		{
+			const auto c = centroid(i);
+			const auto octant = spatial ?
+				(c.x >= middle.x ? 1 : 0) | (c.y >= middle.y ? 2 : 0) | (c.z >= middle.z ? 4 : 0) :
+				static_cast<int>(triangle / run);
+
+			auto& child = children[octant];
+			if (!child.is_open())
+			{
+				paths[octant] = path;
+				paths[octant].replace_extension().concat("_" + std::to_string(octant) + ".bin");
+				child.open(paths[octant], std::ios::binary);
+			}
+			child.write(reinterpret_cast<const char*>(&block[i * 3]), kTriangleBytes);
+		}
+	}
+
+	for (size_t octant = 0; octant < 8; ++octant)
+	{
+		if (!children[octant].is_open())
+		{
+			continue;
+		}
+
+		children[octant].close();
+		if (children[octant].fail())
+		{
+			throw std::runtime_error("Error writing " + paths[octant].string());
+		}
+	}
+	ifs.close();
+	fs::remove(path);
+
+	paths.erase(std::remove(paths.begin(), paths.end(), fs::path{}), paths.end());
+	return paths;
+}
+
+void ChunkBuilder::AddChild(uint32_t index, const MeshData& child, BuildRecord& record, float& childError, MeshData& geometry) const
+{
+	record.children.emplace_back(index);
+	childError = std::max(childError, mRecords[index].node.error);
+
+	const auto base = static_cast<unsigned int>(geometry.vertices.size());
+	geometry.vertices.insert(geometry.vertices.end(), child.vertices.begin(), child.vertices.end());
+	for (auto i : child.indices)
+	{
+		geometry.indices.emplace_back(base + i);
+	}
+}
+
+uint32_t ChunkBuilder::FinishNode(BuildRecord record, MeshData& geometry, float childError, bool inner)
+{
+	bool simplified = false;
+	if (inner)
+	{
+		WeldVertices(geometry);
+		const auto triangles = geometry.indices.size() / 3;
+		if (triangles > mOptions.leafTriangles)
+		{
+			Simplify(geometry, static_cast<float>(mOptions.leafTriangles) / static_cast<float>(triangles));
+			simplified = true;
+		}
+	}
+	OptimizeVertexCache(geometry);
+
+	auto& node = record.node;
+	glm::vec3 lower{ FLT_MAX }, upper{ -FLT_MAX };
+	for (const auto& v : geometry.vertices)
+	{
+		lower = glm::min(lower, v);
+		upper = glm::max(upper, v);
+	}
+	std::memcpy(node.lower, &lower, sizeof node.lower);
+	std::memcpy(node.upper, &upper, sizeof node.upper);
+
+	// The clustering cell size is not known here, use the mean edge length the
+	// triangle density implies as the error of a simplified node
+	node.error = childError;
+	if (simplified)
+	{
+		const auto triangles = std::max<size_t>(geometry.indices.size() / 3, 1);
+		const float edge = glm::length(upper - lower) * std::sqrt(2.0f / static_cast<float>(triangles));
+		node.error = std::max(childError, edge);
+	}
+
+	node.vertexCount = static_cast<uint32_t>(geometry.vertices.size());
+	node.indexCount = static_cast<uint32_t>(geometry.indices.size());
+	node.offset = mStats.bytesWritten;
+	mChunkFile.write(reinterpret_cast<const char*>(geometry.vertices.data()), geometry.vertices.size() * sizeof geometry.vertices[0]);
+	mChunkFile.write(reinterpret_cast<const char*>(geometry.indices.data()), geometry.indices.size() * sizeof geometry.indices[0]);
+	if (!mChunkFile.good())
+	{
+		throw std::runtime_error("Error writing chunk data");
+	}
+	mStats.bytesWritten += node.GetByteSize();
+
+	mRecords.emplace_back(std::move(record));
+	return static_cast<uint32_t>(mRecords.size() - 1);
+}
+
+void ChunkBuilder::WriteHierarchy() const
+{
+	// Breadth first order keeps the children of every node next to each other
+	const auto root = static_cast<uint32_t>(mRecords.size() - 1);
+	std::vector<uint32_t> order{ root };
+	std::vector<uint32_t> remap(mRecords.size());
+	for (size_t i = 0; i < order.size(); ++i)
+	{
+		remap[order[i]] = static_cast<uint32_t>(i);
+		for (auto child : mRecords[order[i]].children)
+		{
+			order.emplace_back(child);
+		}
+	}
+
+	ChunkFileHeader header{};
+	std::memcpy(header.magic, kChunkMagic, sizeof kChunkMagic);
+	header.version = kChunkVersion;
+	header.nodeCount = static_cast<uint32_t>(order.size());
+	header.depth = mStats.depth;
+
+	const auto path = mTemp / kChunkHierarchyFile;
+	std::ofstream ofs{ path, std::ios::binary };
+	ofs.write(reinterpret_cast<const char*>(&header), sizeof header);
+	for (auto index : order)
+	{
+		const auto& record = mRecords[index];
+		auto node = record.node;
+		node.childCount = static_cast<uint32_t>(record.children.size());
+		node.firstChild = record.children.empty() ? 0 : remap[record.children.front()];
+		ofs.write(reinterpret_cast<const char*>(&node), sizeof node);
+	}
+
+	ofs.close();
+	if (ofs.fail())
+	{
+		throw std::runtime_error("Error writing " + path.string());
+	}
+}
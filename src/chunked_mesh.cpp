@@ -0,0 +1,478 @@
+#include "chunked_mesh.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <exception>
+#include <fstream>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "alloc_tracker.hpp"
+
+static constexpr size_t kUploadBytesPerFrame = 32ull << 20;
+static constexpr unsigned int kMaxPendingReads = 8;
+
+double ChunkCacheStats::GetHitRate() const
+{
+	return accesses ? static_cast<double>(vramHits) / static_cast<double>(accesses) : 0.0;
+}
+
+double ChunkCacheStats::GetReadThroughput() const
+{
+	return readSeconds > 0.0 ? static_cast<double>(bytesRead) / (1024.0 * 1024.0) / readSeconds : 0.0;
+}
+
+ChunkedMesh::ChunkedMesh(const std::filesystem::path& directory, size_t ramBudget, size_t vramBudget) :
+	mCenter{},
+	mScale{ 1.0f },
+	mErrorThreshold{ 2.0f },
+	mFrame{},
+	mStats{},
+	mBytesRead{},
+	mReadSeconds{},
+	mStop{}
+{
+	const auto path = directory / kChunkHierarchyFile;
+	std::ifstream ifs{ path, std::ios::binary };
+	if (!ifs.good())
+	{
+		throw std::runtime_error("Error loading chunk hierarchy " + path.string());
+	}
+
+	ChunkFileHeader header{};
+	ifs.read(reinterpret_cast<char*>(&header), sizeof header);
+	if (!ifs.good() || std::memcmp(header.magic, kChunkMagic, sizeof kChunkMagic) != 0 || header.version != kChunkVersion || header.nodeCount == 0)
+	{
+		throw std::runtime_error("Not a chunk hierarchy: " + path.string());
+	}
+
+	mNodes.resize(header.nodeCount);
+	ifs.read(reinterpret_cast<char*>(mNodes.data()), mNodes.size() * sizeof mNodes[0]);
+	if (!ifs.good())
+	{
+		throw std::runtime_error("Truncated chunk hierarchy: " + path.string());
+	}
+
+	// Children come after their parent, so selection can not loop, and every
+	// chunk lies inside chunks.bin as the triangles its counts describe
+	std::error_code ec;
+	const auto dataBytes = std::filesystem::file_size(directory / kChunkDataFile, ec);
+	if (ec)
+	{
+		throw std::runtime_error("Error loading chunk data " + (directory / kChunkDataFile).string());
+	}
+	for (size_t node = 0; node < mNodes.size(); ++node)
+	{
+		const auto& info = mNodes[node];
+		const bool childrenValid = info.childCount == 0 ||
+			(info.firstChild > node && uint64_t{ info.firstChild } + info.childCount <= mNodes.size());
+		const bool countsValid = info.indexCount % 3 == 0 && info.indexCount <= INT32_MAX &&
+			(info.indexCount == 0 || info.vertexCount > 0);
+		if (!childrenValid || !countsValid || info.offset > dataBytes || info.GetByteSize() > dataBytes - info.offset)
+		{
+			throw std::runtime_error("Corrupt chunk hierarchy: " + path.string());
+		}
+	}
+	mStates.resize(mNodes.size());
+
+	const auto& root = mNodes.front();
+	const glm::vec3 lower{ root.lower[0], root.lower[1], root.lower[2] };
+	const glm::vec3 upper{ root.upper[0], root.upper[1], root.upper[2] };
+	const auto size = upper - lower;
+	mCenter = (lower + upper) * 0.5f;
+	mScale = 1.0f / std::max(std::max(size.x, size.y), std::max(size.z, 1e-6f));
+
+	mStats.ramBudget = ramBudget;
+	mStats.vramBudget = vramBudget;
+
+	mReader = std::thread{ &ChunkedMesh::ReadLoop, this, directory / kChunkDataFile };
+}
+
+ChunkedMesh::~ChunkedMesh()
+{
+	{
+		std::lock_guard lock{ mMutex };
+		mStop = true;
+	}
+	mWake.notify_all();
+	mReader.join();
+
+	for (uint32_t node = 0; node < mNodes.size(); ++node)
+	{
+		ReleaseGpu(node);
+	}
+}
+
+void ChunkedMesh::ReadLoop(std::filesystem::path path)
+{
+	AllocScope scope{ AllocSubsystem::Chunks };
+	std::ifstream file{ path, std::ios::binary };
+
+	while (true)
+	{
+		uint32_t node;
+		{
+			std::unique_lock lock{ mMutex };
+			mWake.wait(lock, [this] { return mStop || !mReadQueue.empty(); });
+			if (mStop)
+			{
+				return;
+			}
+			node = mReadQueue.front();
+			mReadQueue.pop_front();
+		}
+
+		const auto& info = mNodes[node];
+		std::vector<char> data(info.GetByteSize());
+
+		const auto start = std::chrono::steady_clock::now();
+		file.seekg(static_cast<std::streamoff>(info.offset));
+		file.read(data.data(), static_cast<std::streamsize>(data.size()));
+		const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+		if (!file.good())
+		{
+			// A short read is handed back empty, the main thread drops it
+			file.clear();
+			data.clear();
+		}
+
+		std::lock_guard lock{ mMutex };
+		mBytesRead += data.size();
+		mReadSeconds += elapsed.count();
+		mCompleted.emplace_back(node, std::move(data));
+	}
+}
+
+void ChunkedMesh::CollectReads()
+{
+	std::vector<std::pair<uint32_t, std::vector<char>>> completed;
+	{
+		std::lock_guard lock{ mMutex };
+		completed.swap(mCompleted);
+		mStats.bytesRead = mBytesRead;
+		mStats.readSeconds = mReadSeconds;
+	}
+
+	for (auto& [node, data] : completed)
+	{
+		auto& state = mStates[node];
+		state.reading = false;
+		--mStats.pendingReads;
+
+		if (data.size() != mNodes[node].GetByteSize())
+		{
+			mStats.ramBytes -= mNodes[node].GetByteSize();
+			continue;
+		}
+
+		state.data = std::move(data);
+		state.inRam = true;
+		mRamLru.push_front(node);
+		state.ramLru = mRamLru.begin();
+	}
+}
+
+void ChunkedMesh::Update(const glm::mat4& model, const glm::vec3& eye, float fieldOfView, float viewportHeight)
+{
+	AllocScope scope{ AllocSubsystem::Chunks };
+	++mFrame;
+	CollectReads();
+
+	mDrawList.clear();
+	mUploads.clear();
+	mReads.clear();
+	Select(model, eye, viewportHeight / (2.0f * std::tan(fieldOfView * 0.5f)));
+
+	const auto byPriority = [](const Request& a, const Request& b) { return a.priority > b.priority; };
+
+	// Chunks already in RAM only need an upload
+	std::sort(mUploads.begin(), mUploads.end(), byPriority);
+	size_t uploaded = 0;
+	for (const auto& request : mUploads)
+	{
+		const auto bytes = mNodes[request.node].GetByteSize();
+		if (uploaded > 0 && uploaded + bytes > kUploadBytesPerFrame)
+		{
+			break;
+		}
+		if (!ReserveVram(bytes))
+		{
+			++mStats.deferred;
+			continue;
+		}
+
+		Upload(request.node);
+		uploaded += bytes;
+		++mStats.ramHits;
+	}
+
+	// Everything else goes to the reader, RAM is reserved up front
+	std::sort(mReads.begin(), mReads.end(), byPriority);
+	bool submitted = false;
+	for (const auto& request : mReads)
+	{
+		if (mStats.pendingReads >= kMaxPendingReads)
+		{
+			break;
+		}
+		if (!ReserveRam(mNodes[request.node].GetByteSize()))
+		{
+			++mStats.deferred;
+			continue;
+		}
+
+		mStates[request.node].reading = true;
+		++mStats.pendingReads;
+		++mStats.diskReads;
+		submitted = true;
+
+		std::lock_guard lock{ mMutex };
+		mReadQueue.emplace_back(request.node);
+	}
+	if (submitted)
+	{
+		mWake.notify_one();
+	}
+
+	mStats.drawnChunks = static_cast<unsigned int>(mDrawList.size());
+	mStats.drawnTriangles = 0;
+	for (auto node : mDrawList)
+	{
+		mStats.drawnTriangles += mNodes[node].indexCount / 3;
+	}
+}
+
+void ChunkedMesh::Select(const glm::mat4& model, const glm::vec3& eye, float projection)
+{
+	++mStats.accesses;
+	if (!IsOnGpu(0))
+	{
+		Want(0, FLT_MAX);
+		return;
+	}
+	++mStats.vramHits;
+
+	std::vector<uint32_t> stack{ 0 };
+	while (!stack.empty())
+	{
+		const auto node = stack.back();
+		stack.pop_back();
+		Touch(node);
+
+		const auto& info = mNodes[node];
+		if (info.childCount > 0 && ScreenSpaceError(node, model, eye, projection) > mErrorThreshold)
+		{
+			// Only refine once every child can be drawn, otherwise keep drawing this node
+			bool ready = true;
+			for (uint32_t child = info.firstChild; child < info.firstChild + info.childCount; ++child)
+			{
+				++mStats.accesses;
+				if (IsOnGpu(child))
+				{
+					++mStats.vramHits;
+					Touch(child);
+				}
+				else
+				{
+					ready = false;
+					Want(child, ScreenSpaceError(child, model, eye, projection));
+				}
+			}
+
+			if (ready)
+			{
+				for (uint32_t child = info.firstChild; child < info.firstChild + info.childCount; ++child)
+				{
+					stack.emplace_back(child);
+				}
+				continue;
+			}
+		}
+
+		mDrawList.emplace_back(node);
+	}
+}
+
+float ChunkedMesh::ScreenSpaceError(uint32_t node, const glm::mat4& model, const glm::vec3& eye, float projection) const
+{
+	const auto& info = mNodes[node];
+	const glm::vec3 lower{ info.lower[0], info.lower[1], info.lower[2] };
+	const glm::vec3 upper{ info.upper[0], info.upper[1], info.upper[2] };
+
+	// Uniform scale is assumed, which holds for the viewer's model matrices
+	const float scale = glm::length(glm::vec3(model[0]));
+	const auto center = glm::vec3(model * glm::vec4((lower + upper) * 0.5f, 1.0f));
+	const float radius = glm::length(upper - lower) * 0.5f * scale;
+	const float distance = std::max(glm::length(center - eye) - radius, 1e-4f);
+
+	return info.error * scale * projection / distance;
+}
+
+void ChunkedMesh::Want(uint32_t node, float priority)
+{
+	auto& state = mStates[node];
+	state.lastUsed = mFrame;
+
+	if (state.inRam)
+	{
+		mUploads.push_back({ priority, node });
+	}
+	else if (!state.reading)
+	{
+		mReads.push_back({ priority, node });
+	}
+}
+
+void ChunkedMesh::Touch(uint32_t node)
+{
+	auto& state = mStates[node];
+	state.lastUsed = mFrame;
+
+	if (IsOnGpu(node))
+	{
+		mVramLru.splice(mVramLru.begin(), mVramLru, state.vramLru);
+	}
+	if (state.inRam)
+	{
+		mRamLru.splice(mRamLru.begin(), mRamLru, state.ramLru);
+	}
+}
+
+bool ChunkedMesh::IsOnGpu(uint32_t node) const
+{
+	return mStates[node].vao != 0;
+}
+
+bool ChunkedMesh::ReserveRam(size_t bytes)
+{
+	auto it = mRamLru.end();
+	while (mStats.ramBytes + bytes > mStats.ramBudget)
+	{
+		// Walk from the least recently used end, keeping chunks still waiting for their upload
+		if (it == mRamLru.begin())
+		{
+			return false;
+		}
+
+		--it;
+		const auto node = *it;
+		auto& state = mStates[node];
+		if (state.lastUsed == mFrame && !IsOnGpu(node))
+		{
+			continue;
+		}
+
+		mStats.ramBytes -= state.data.size();
+		std::vector<char>{}.swap(state.data);
+		state.inRam = false;
+		it = mRamLru.erase(it);
+		++mStats.evictions;
+	}
+
+	mStats.ramBytes += bytes;
+	return true;
+}
+
+bool ChunkedMesh::ReserveVram(size_t bytes)
+{
+	auto it = mVramLru.end();
+	while (mStats.vramBytes + bytes > mStats.vramBudget)
+	{
+		// Chunks used this frame are pinned
+		if (it == mVramLru.begin())
+		{
+			return false;
+		}
+
+		--it;
+		const auto node = *it;
+		if (mStates[node].lastUsed == mFrame)
+		{
+			continue;
+		}
+
+		it = mVramLru.erase(it);
+		ReleaseGpu(node);
+		++mStats.evictions;
+	}
+
+	mStats.vramBytes += bytes;
+	return true;
+}
+
+void ChunkedMesh::Upload(uint32_t node)
+{
+	auto& state = mStates[node];
+	const auto& info = mNodes[node];
+	const auto vertexBytes = static_cast<GLsizeiptr>(info.vertexCount * sizeof(glm::vec3));
+	const auto indexBytes = static_cast<GLsizeiptr>(info.indexCount * sizeof(uint32_t));
+
+	glGenVertexArrays(1, &state.vao);
+	glBindVertexArray(state.vao);
+
+	glGenBuffers(1, &state.vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, state.vbo);
+	glBufferData(GL_ARRAY_BUFFER, vertexBytes, state.data.data(), GL_STATIC_DRAW);
+
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+	glEnableVertexAttribArray(0);
+
+	glGenBuffers(1, &state.ebo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, state.ebo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, state.data.data() + vertexBytes, GL_STATIC_DRAW);
+
+	glBindVertexArray(0);
+
+	state.lastUsed = mFrame;
+	mVramLru.push_front(node);
+	state.vramLru = mVramLru.begin();
+}
+
+void ChunkedMesh::ReleaseGpu(uint32_t node)
+{
+	auto& state = mStates[node];
+	if (state.vao == 0)
+	{
+		return;
+	}
+
+	glDeleteVertexArrays(1, &state.vao);
+	glDeleteBuffers(1, &state.vbo);
+	glDeleteBuffers(1, &state.ebo);
+	state.vao = state.vbo = state.ebo = 0;
+	mStats.vramBytes -= mNodes[node].GetByteSize();
+}
+
+void ChunkedMesh::Draw() const
+{
+	for (auto node : mDrawList)
+	{
+		glBindVertexArray(mStates[node].vao);
+		glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(mNodes[node].indexCount), GL_UNSIGNED_INT, nullptr);
+	}
+	glBindVertexArray(0);
+}
+
+glm::mat4 ChunkedMesh::GetNormalizeMatrix() const
+{
+	return glm::scale(glm::mat4{ 1.0f }, glm::vec3{ mScale }) * glm::translate(glm::mat4{ 1.0f }, -mCenter);
+}
+
+const ChunkCacheStats& ChunkedMesh::GetStats() const
+{
+	return mStats;
+}
+
+float ChunkedMesh::GetErrorThreshold() const
+{
+	return mErrorThreshold;
+}
+
+void ChunkedMesh::SetErrorThreshold(float pixels)
+{
+	mErrorThreshold = pixels;
+}
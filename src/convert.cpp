@@ -0,0 +1,131 @@
+#include <cstdlib>
+#include <iostream>
+#include <string_view>
+
+#include "converter.hpp"
+
+static
+void PrintUsage()
+{
+	std::cerr <<
+		"usage: obj_convert <input .obj or directory> <output directory> [options]\n"
+		"  --format meshbin|gltf|glb|ply|chunks\n"
+		"                                  output format (default meshbin), chunks builds an\n"
+		"                                  out-of-core hierarchy for the viewer\n"
+		"  --weld [epsilon]                merge duplicate vertices\n"
+		"  --triangulate                   fan triangulate polygons\n"
+		"  --optimize                      reorder for the vertex cache and fetch locality\n"
+		"  --simplify <ratio>              keep roughly ratio of the triangles\n"
+		"  --normals [degrees]             generate smooth normals, split at the crease angle (default 60)\n"
+		"  --tangents                      also generate MikkTSpace style tangents for textured meshes\n"
+		"  --chunk-triangles <n>           triangles per out-of-core chunk (default 65536)\n"
+		"  --chunk-memory-mb <n>           memory budget of each chunk build (default 512)\n"
+		"  --jobs <n>                      worker threads (default: all cores)\n"
+		"  --queue <n>                     pending file queue capacity (default: 2 * jobs)\n";
+}
+
+static
+bool ParseFormat(std::string_view name, ExportFormat& format)
+{
+	if (name == "meshbin") format = ExportFormat::MeshCache;
+	else if (name == "gltf") format = ExportFormat::Gltf;
+	else if (name == "glb") format = ExportFormat::Glb;
+	else if (name == "ply") format = ExportFormat::Ply;
+	else if (name == "chunks") format = ExportFormat::Chunks;
+	else return false;
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 3)
+	{
+		PrintUsage();
+		return EXIT_FAILURE;
+	}
+
+	ConvertOptions options;
+	options.input = argv[1];
+	options.output = argv[2];
+
+	for (int i = 3; i < argc; ++i)
+	{
+		const std::string_view arg = argv[i];
+		const bool hasValue = i + 1 < argc;
+
+		if (arg == "--format" && hasValue)
+		{
+			if (!ParseFormat(argv[++i], options.format))
+			{
+				std::cerr << "Unknown format " << argv[i] << ", expected meshbin, gltf, glb, ply or chunks\n";
+				return EXIT_FAILURE;
+			}
+		}
+		else if (arg == "--weld")
+		{
+			options.weld = true;
+			if (hasValue && argv[i + 1][0] != '-')
+			{
+				options.weldEpsilon = std::strtof(argv[++i], nullptr);
+			}
+		}
+		else if (arg == "--triangulate")
+		{
+			options.triangulate = true;
+		}
+		else if (arg == "--optimize")
+		{
+			options.optimize = true;
+		}
+		else if (arg == "--normals")
+		{
+			options.normals = true;
+			if (hasValue && argv[i + 1][0] != '-')
+			{
+				options.creaseAngle = std::strtof(argv[++i], nullptr);
+			}
+		}
+		else if (arg == "--tangents")
+		{
+			options.normals = true;
+			options.tangents = true;
+		}
+		else if (arg == "--simplify" && hasValue)
+		{
+			char* end = nullptr;
+			options.simplifyRatio = std::strtof(argv[++i], &end);
+			if (end == argv[i] || *end != '\0' || !(options.simplifyRatio > 0.0f && options.simplifyRatio <= 1.0f))
+			{
+				std::cerr << "Invalid simplify ratio " << argv[i] << ", expected a number in (0, 1]\n";
+				return EXIT_FAILURE;
+			}
+		}
+		else if (arg == "--chunk-triangles" && hasValue)
+		{
+			options.chunkTriangles = std::strtoull(argv[++i], nullptr, 10);
+		}
+		else if (arg == "--chunk-memory-mb" && hasValue)
+		{
+			options.chunkMemory = std::strtoull(argv[++i], nullptr, 10) << 20;
+		}
+		else if (arg == "--jobs" && hasValue)
+		{
+			options.jobs = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+		}
+		else if (arg == "--queue" && hasValue)
+		{
+			options.queueCapacity = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+		}
+		else
+		{
+			std::cerr << "Unknown option " << arg << "\n";
+			PrintUsage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	Converter converter{ options };
+	const int failed = converter.Run();
+	converter.PrintReport(std::cout);
+	return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,379 @@
+#include "converter.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <thread>
+
+#include "alloc_tracker.hpp"
+#include "chunk_builder.hpp"
+#include "mesh.hpp"
+#include "mesh_io.hpp"
+#include "mesh_processing.hpp"
+#include "tangent_space.hpp"
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+// Blocking queue with a fixed capacity, Push waits while the queue is full
+template <typename T>
+class BoundedQueue
+{
+public:
+	explicit BoundedQueue(size_t capacity) : mCapacity{ capacity }, mClosed{}
+	{
+	}
+
+	void Push(T value)
+	{
+		std::unique_lock lock{ mMutex };
+		mNotFull.wait(lock, [this] { return mItems.size() < mCapacity; });
+		mItems.push(std::move(value));
+		mNotEmpty.notify_one();
+	}
+
+	// Returns nothing once the queue is closed and drained
+	std::optional<T> Pop()
+	{
+		std::unique_lock lock{ mMutex };
+		mNotEmpty.wait(lock, [this] { return !mItems.empty() || mClosed; });
+		if (mItems.empty())
+		{
+			return std::nullopt;
+		}
+
+		T value = std::move(mItems.front());
+		mItems.pop();
+		mNotFull.notify_one();
+		return value;
+	}
+
+	void Close()
+	{
+		std::lock_guard lock{ mMutex };
+		mClosed = true;
+		mNotEmpty.notify_all();
+	}
+
+private:
+	std::mutex mMutex;
+	std::condition_variable mNotEmpty, mNotFull;
+	std::queue<T> mItems;
+	size_t mCapacity;
+	bool mClosed;
+};
+
+static
+double ElapsedMs(Clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static
+bool IsObj(const fs::path& path)
+{
+	auto extension = path.extension().string();
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return std::tolower(c); });
+	return extension == ".obj";
+}
+
+static
+const char* Extension(ExportFormat format)
+{
+	switch (format)
+	{
+	case ExportFormat::Gltf: return ".gltf";
+	case ExportFormat::Glb: return ".glb";
+	case ExportFormat::Ply: return ".ply";
+	case ExportFormat::Chunks: return ".chunks";
+	default: return ".meshbin";
+	}
+}
+
+Converter::Converter(ConvertOptions options) :
+	mOptions{ std::move(options) },
+	mWallMs{}
+{
+	if (mOptions.jobs == 0)
+	{
+		mOptions.jobs = std::max(1u, std::thread::hardware_concurrency());
+	}
+	if (mOptions.queueCapacity == 0)
+	{
+		mOptions.queueCapacity = mOptions.jobs * 2;
+	}
+}
+
+int Converter::Run()
+{
+	const auto start = Clock::now();
+	mResults.clear();
+
+	BoundedQueue<fs::path> queue{ mOptions.queueCapacity };
+	std::mutex resultsMutex;
+
+	std::vector<std::thread> workers;
+	for (unsigned int i = 0; i < mOptions.jobs; ++i)
+	{
+		workers.emplace_back([&]
+		{
+			while (auto source = queue.Pop())
+			{
+				auto result = Convert(*source);
+
+				std::lock_guard lock{ resultsMutex };
+				mResults.emplace_back(std::move(result));
+			}
+		});
+	}
+
+	// Unreadable directories are reported as failed entries and skipped, the
+	// rest of the batch still runs
+	const auto addWalkError = [&](const fs::path& path, const std::error_code& error)
+	{
+		ConvertResult result;
+		result.source = path;
+		result.error = "Error reading directory: " + error.message();
+
+		std::lock_guard lock{ resultsMutex };
+		mResults.emplace_back(std::move(result));
+	};
+
+	// Directory walk happens on this thread and stalls whenever the workers fall behind
+	std::error_code ec;
+	if (fs::is_directory(mOptions.input, ec))
+	{
+		fs::recursive_directory_iterator it{ mOptions.input, fs::directory_options::skip_permission_denied, ec };
+		for (; !ec && it != fs::recursive_directory_iterator{}; it.increment(ec))
+		{
+			std::error_code entryError;
+			if (it->is_directory(entryError))
+			{
+				// Probe before descending, the iterator would skip it silently
+				if (fs::directory_iterator probe{ it->path(), entryError }; entryError)
+				{
+					addWalkError(it->path(), entryError);
+					it.disable_recursion_pending();
+				}
+			}
+			else if (it->is_regular_file(entryError) && IsObj(it->path()))
+			{
+				queue.Push(it->path());
+			}
+		}
+
+		if (ec)
+		{
+			addWalkError(mOptions.input, ec);
+		}
+	}
+	else
+	{
+		queue.Push(mOptions.input);
+	}
+
+	queue.Close();
+	for (auto& worker : workers)
+	{
+		worker.join();
+	}
+
+	std::sort(mResults.begin(), mResults.end(), [](const auto& a, const auto& b) { return a.source < b.source; });
+	mWallMs = ElapsedMs(start);
+
+	return static_cast<int>(std::count_if(mResults.begin(), mResults.end(), [](const auto& r) { return !r.error.empty(); }));
+}
+
+const std::vector<ConvertResult>& Converter::GetResults() const
+{
+	return mResults;
+}
+
+fs::path Converter::OutputPath(const fs::path& source) const
+{
+	auto relative = fs::is_directory(mOptions.input) ?
+		source.lexically_relative(mOptions.input) :
+		source.filename();
+
+	auto path = mOptions.output / relative;
+	path.replace_extension(Extension(mOptions.format));
+	return path;
+}
+
+ConvertResult Converter::Convert(const fs::path& source) const
+{
+	ConvertResult result;
+	result.source = source;
+
+	try
+	{
+		if (mOptions.format == ExportFormat::Chunks)
+		{
+			return BuildChunks(source);
+		}
+
+		auto start = Clock::now();
+		auto data = Mesh::Parse(source.string().c_str());
+		result.parseMs = ElapsedMs(start);
+
+		start = Clock::now();
+		std::optional<AllocScope> scope{ std::in_place, AllocSubsystem::MeshProcessing };
+		if (mOptions.weld)
+		{
+			WeldVertices(data, mOptions.weldEpsilon);
+		}
+		if (mOptions.triangulate || mOptions.format == ExportFormat::Gltf || mOptions.format == ExportFormat::Glb)
+		{
+			Triangulate(data);
+		}
+		if (mOptions.simplifyRatio < 1.0f)
+		{
+			Simplify(data, mOptions.simplifyRatio);
+		}
+		if (mOptions.normals || mOptions.tangents)
+		{
+			// The jobs already keep every core busy on batches, share them out for single big files
+			const unsigned int threads = std::max(1u, std::thread::hardware_concurrency() / mOptions.jobs);
+			const bool tangents = mOptions.tangents && !data.texCoords.empty();
+			TangentSpaceGenerator{ TangentSpaceOptions{ mOptions.creaseAngle, tangents, threads } }.Generate(data);
+		}
+		if (mOptions.optimize)
+		{
+			OptimizeVertexCache(data);
+		}
+		result.processMs = ElapsedMs(start);
+
+		result.vertices = data.vertices.size();
+		if (data.faceSizes.empty())
+		{
+			result.triangles = data.indices.size() / 3;
+		}
+		else
+		{
+			for (auto corners : data.faceSizes)
+			{
+				result.triangles += corners >= 3 ? corners - 2 : 0;
+			}
+		}
+
+		start = Clock::now();
+		scope.emplace(AllocSubsystem::Export);
+		const auto path = OutputPath(source);
+		fs::create_directories(path.parent_path());
+		switch (mOptions.format)
+		{
+		case ExportFormat::MeshCache:
+			WriteMeshCache(path, data);
+			break;
+		case ExportFormat::Gltf:
+		case ExportFormat::Glb:
+			WriteGltf(path, data, mOptions.format == ExportFormat::Glb);
+			break;
+		case ExportFormat::Ply:
+			WritePly(path, data);
+			break;
+		default:
+			break;
+		}
+		result.writeMs = ElapsedMs(start);
+
+		result.outputBytes = fs::file_size(path);
+		if (mOptions.format == ExportFormat::Gltf)
+		{
+			result.outputBytes += fs::file_size(fs::path{ path }.replace_extension(".bin"));
+		}
+	}
+	catch (const std::exception& e)
+	{
+		result.error = e.what();
+	}
+	return result;
+}
+
+ConvertResult Converter::BuildChunks(const fs::path& source) const
+{
+	ConvertResult result;
+	result.source = source;
+
+	AllocScope scope{ AllocSubsystem::Chunks };
+	const auto start = Clock::now();
+	const auto path = OutputPath(source);
+	ChunkBuilder builder{ source, path, ChunkBuildOptions{ mOptions.chunkTriangles, mOptions.chunkMemory } };
+	const auto stats = builder.Build();
+	result.processMs = ElapsedMs(start);
+
+	result.vertices = stats.vertices;
+	result.triangles = stats.triangles;
+	for (const auto& entry : fs::directory_iterator{ path })
+	{
+		result.outputBytes += entry.file_size();
+	}
+	return result;
+}
+
+void Converter::PrintReport(std::ostream& os) const
+{
+	double parseMs{}, processMs{}, writeMs{};
+	size_t triangles{}, bytes{}, failed{};
+
+	os << std::fixed << std::setprecision(2)
+		<< std::left << std::setw(40) << "file" << std::right
+		<< std::setw(12) << "vertices" << std::setw(12) << "triangles"
+		<< std::setw(10) << "parse ms" << std::setw(12) << "process ms" << std::setw(10) << "write ms"
+		<< std::setw(12) << "output KB" << "\n";
+
+	for (const auto& r : mResults)
+	{
+		auto name = r.source.filename().string();
+		if (!r.error.empty())
+		{
+			os << std::left << std::setw(40) << name << std::right << "  FAILED: " << r.error << "\n";
+			++failed;
+			continue;
+		}
+
+		os << std::left << std::setw(40) << name << std::right
+			<< std::setw(12) << r.vertices << std::setw(12) << r.triangles
+			<< std::setw(10) << r.parseMs << std::setw(12) << r.processMs << std::setw(10) << r.writeMs
+			<< std::setw(12) << r.outputBytes / 1024.0 << "\n";
+
+		parseMs += r.parseMs;
+		processMs += r.processMs;
+		writeMs += r.writeMs;
+		triangles += r.triangles;
+		bytes += r.outputBytes;
+	}
+
+	os << "\n" << mResults.size() - failed << " converted, " << failed << " failed, "
+		<< mOptions.jobs << " jobs, " << mWallMs << " ms wall\n"
+		<< "cpu time: parse " << parseMs << " ms, process " << processMs << " ms, write " << writeMs << " ms\n"
+		<< "output: " << triangles << " triangles, " << bytes / (1024.0 * 1024.0) << " MB\n";
+
+	if (!AllocTracker::IsEnabled())
+	{
+		return;
+	}
+
+	os << "\n" << std::left << std::setw(20) << "allocations" << std::right
+		<< std::setw(14) << "count" << std::setw(14) << "total MB" << std::setw(14) << "peak MB" << "\n";
+	const auto row = [&os](const char* name, const AllocCounters& counters)
+	{
+		os << std::left << std::setw(20) << name << std::right
+			<< std::setw(14) << counters.count
+			<< std::setw(14) << counters.bytes / (1024.0 * 1024.0)
+			<< std::setw(14) << counters.peakBytes / (1024.0 * 1024.0) << "\n";
+	};
+	for (size_t i = 0; i < static_cast<size_t>(AllocSubsystem::Count); ++i)
+	{
+		const auto subsystem = static_cast<AllocSubsystem>(i);
+		row(AllocTracker::GetName(subsystem), AllocTracker::Get(subsystem));
+	}
+	row("total", AllocTracker::GetTotal());
+}
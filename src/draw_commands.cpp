@@ -0,0 +1,155 @@
+#include "draw_commands.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+static constexpr size_t kMinObjectsPerWorker = 1024;
+
+MeshRange MakeMeshRange(std::span<const glm::vec3> vertices, uint32_t indexCount, uint32_t firstIndex, int32_t baseVertex)
+{
+	MeshRange range{};
+	range.indexCount = indexCount;
+	range.firstIndex = firstIndex;
+	range.baseVertex = baseVertex;
+	if (vertices.empty())
+	{
+		return range;
+	}
+
+	glm::vec3 lower = vertices.front();
+	glm::vec3 upper = lower;
+	for (const auto& vertex : vertices)
+	{
+		lower = glm::min(lower, vertex);
+		upper = glm::max(upper, vertex);
+	}
+
+	range.center = (lower + upper) * 0.5f;
+	for (const auto& vertex : vertices)
+	{
+		range.radius = std::max(range.radius, glm::distance(vertex, range.center));
+	}
+	return range;
+}
+
+DrawCommandBuilder::DrawCommandBuilder(unsigned int threads) :
+	mPool{ threads },
+	mPlanes{},
+	mCount{}
+{
+	mCounts.resize(mPool.GetThreadCount());
+	mOffsets.resize(mPool.GetThreadCount());
+}
+
+void DrawCommandBuilder::Build(std::span<const MeshRange> meshes, std::span<const DrawObject> objects, const glm::mat4& viewProjection)
+{
+	mMeshes = meshes;
+	mObjects = objects;
+
+	// Gribb/Hartmann planes, normalised so that the distance compares against a radius
+	for (int i = 0; i < 3; ++i)
+	{
+		for (int side = 0; side < 2; ++side)
+		{
+			const float sign = side == 0 ? 1.0f : -1.0f;
+			glm::vec4 plane;
+			for (int column = 0; column < 4; ++column)
+			{
+				plane[column] = viewProjection[column][3] + sign * viewProjection[column][i];
+			}
+
+			const float length = glm::length(glm::vec3(plane));
+			mPlanes[i * 2 + side] = length > 0.0f ? plane * (1.0f / length) : plane;
+		}
+	}
+
+	if (mVisible.size() < objects.size())
+	{
+		mVisible.resize(objects.size());
+		mCommands.resize(objects.size());
+		mModels.resize(objects.size());
+	}
+
+	// Both passes split the objects the same way
+	const auto active = mPool.GetActiveCount(objects.size(), kMinObjectsPerWorker);
+	mPool.Run(active, [this](unsigned int worker, unsigned int workers) { RunPass(Pass::Cull, worker, workers); });
+
+	mCount = 0;
+	for (unsigned int worker = 0; worker < active; ++worker)
+	{
+		mOffsets[worker] = static_cast<uint32_t>(mCount);
+		mCount += mCounts[worker];
+	}
+
+	mPool.Run(active, [this](unsigned int worker, unsigned int workers) { RunPass(Pass::Emit, worker, workers); });
+}
+
+void DrawCommandBuilder::RunPass(Pass pass, unsigned int worker, unsigned int active)
+{
+	const size_t first = mObjects.size() * worker / active;
+	const size_t last = mObjects.size() * (worker + 1) / active;
+
+	if (pass == Pass::Cull)
+	{
+		uint32_t count = 0;
+		for (size_t object = first; object < last; ++object)
+		{
+			if (IsVisible(mObjects[object]))
+			{
+				mVisible[first + count++] = static_cast<uint32_t>(object);
+			}
+		}
+		mCounts[worker] = count;
+		return;
+	}
+
+	const uint32_t offset = mOffsets[worker];
+	for (uint32_t i = 0; i < mCounts[worker]; ++i)
+	{
+		const auto& object = mObjects[mVisible[first + i]];
+		const auto& mesh = mMeshes[object.mesh];
+
+		auto& command = mCommands[offset + i];
+		command.count = mesh.indexCount;
+		command.instanceCount = 1;
+		command.firstIndex = mesh.firstIndex;
+		command.baseVertex = mesh.baseVertex;
+		command.baseInstance = offset + i;
+		mModels[offset + i] = object.model;
+	}
+}
+
+bool DrawCommandBuilder::IsVisible(const DrawObject& object) const
+{
+	const auto& mesh = mMeshes[object.mesh];
+	const glm::vec3 center{ object.model * glm::vec4(mesh.center, 1.0f) };
+	const float scale = std::max({
+		glm::length(glm::vec3(object.model[0])),
+		glm::length(glm::vec3(object.model[1])),
+		glm::length(glm::vec3(object.model[2])) });
+	const float radius = mesh.radius * scale;
+
+	for (const auto& plane : mPlanes)
+	{
+		if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+std::span<const DrawElementsIndirectCommand> DrawCommandBuilder::GetCommands() const
+{
+	return { mCommands.data(), mCount };
+}
+
+std::span<const glm::mat4> DrawCommandBuilder::GetModels() const
+{
+	return { mModels.data(), mCount };
+}
+
+unsigned int DrawCommandBuilder::GetThreadCount() const
+{
+	return static_cast<unsigned int>(mCounts.size());
+}
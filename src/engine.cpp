@@ -2,6 +2,9 @@
 
 #include <iostream>
 #include <exception>
+#include <filesystem>
+#include <memory>
+#include <vector>
 
 #include <glad/gl.h>
 #include <GLFW/glfw3.h>
@@ -17,6 +20,11 @@
 #include "shader.hpp"
 #include "mesh.hpp"
 #include "camera.hpp"
+#include "chunked_mesh.hpp"
+#include "scene_renderer.hpp"
+#include "gl_context.hpp"
+#include "alloc_tracker.hpp"
+#include "tangent_space.hpp"
 
 static const char* glsl_version = "#version 330 core";
 
@@ -49,9 +57,10 @@ glm::quat mouseDeltaToQuat(const glm::vec2& delta, const float radius) {
 }
 
 
-Engine::Engine(int width, int height) :
+Engine::Engine(int width, int height, EngineOptions options) :
     mWidth{ width }, 
-    mHeight{ height }
+    mHeight{ height },
+    mOptions{ std::move(options) }
 {
     if (!glfwInit()) 
     {
@@ -59,24 +68,15 @@ Engine::Engine(int width, int height) :
         throw std::system_error(std::error_code(), "Error initializing glfw3");
     }
 
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-
-    mWindow = glfwCreateWindow(width, height, "Hello World", nullptr, nullptr);
-    if (!mWindow) 
+    // 4.3 enables the multi-draw indirect scene path, 3.3 is the fallback
+    try
     {
-        std::cerr << "Error creating glfw3 window\n";
-        glfwTerminate();
-        throw std::system_error(std::error_code(), "Error creating glfw3 window");
+        mWindow = CreateGLWindow(width, height, "Hello World", true, mOptions.indirect);
     }
-
-    glfwMakeContextCurrent(mWindow);
-
-    int version = gladLoadGL(glfwGetProcAddress);
-    if (version == 0) 
+    catch (const std::exception&)
     {
-        std::cerr << "Failed to initialize GLAD\n";
-        throw std::system_error(std::error_code(), "Error initializing glfw3");
+        glfwTerminate();
+        throw;
     }
 }
 
@@ -122,8 +122,49 @@ void Engine::Run()
 {
     Init();
 
+    // A directory is an out-of-core mesh built by obj_convert --format chunks
     auto mesh = Mesh();
-    mesh.Load("assets/meshes/cube.obj");
+    std::unique_ptr<ChunkedMesh> chunked;
+    std::unique_ptr<SceneRenderer> scene;
+    std::vector<DrawObject> sceneObjects;
+    bool lit = false;  // the single mesh has normals, draw it shaded instead of in wireframe
+    if (std::filesystem::is_directory(mOptions.meshPath))
+    {
+        chunked = std::make_unique<ChunkedMesh>(mOptions.meshPath, mOptions.ramBudget, mOptions.vramBudget);
+    }
+    else if (mOptions.gridSize > 0)
+    {
+        // A grid of copies scaled to fit the unit cube, drawn through the scene renderer
+        scene = std::make_unique<SceneRenderer>();
+        scene->SetIndirect(mOptions.indirect);
+        const auto meshId = scene->AddMesh(Mesh::Prepare(mOptions.meshPath.c_str()));
+
+        const auto n = mOptions.gridSize;
+        const float spacing = 1.0f / static_cast<float>(n);
+        for (unsigned int x = 0; x < n; ++x)
+        {
+            for (unsigned int y = 0; y < n; ++y)
+            {
+                for (unsigned int z = 0; z < n; ++z)
+                {
+                    const auto offset = (glm::vec3(x, y, z) - glm::vec3(0.5f * (n - 1))) * spacing;
+                    const auto model = glm::scale(glm::translate(glm::mat4(1.0f), offset), glm::vec3(spacing * 0.75f));
+                    sceneObjects.push_back({ meshId, model });
+                }
+            }
+        }
+    }
+    else
+    {
+        auto data = Mesh::Prepare(mOptions.meshPath.c_str());
+        if (mOptions.normals)
+        {
+            AllocScope scope{ AllocSubsystem::MeshProcessing };
+            GenerateNormals(data, mOptions.creaseAngle);
+        }
+        lit = !data.normals.empty();
+        mesh.Upload(data);
+    }
     // mesh.Load("assets/meshes/suzzane.obj");
     // mesh.Load("assets/meshes/teapot.obj");
     // mesh.Load("assets/meshes/stanford-bunny.obj");
@@ -135,6 +176,7 @@ void Engine::Run()
 
     Shader shader{"assets/shaders/model.vs", "assets/shaders/model.fs"};
     shader.SetFloat("outColor", 1.0f);
+    Shader litShader{"assets/shaders/model_lit.vs", "assets/shaders/model_lit.fs"};
 
     float horizontalAngle = 3.14f;
     float verticalAngle = 0.0f;
@@ -149,11 +191,19 @@ void Engine::Run()
     glm::quat objRotation{};
     glm::vec3 cameraDir{};
 
-    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+    if (lit)
+    {
+        glEnable(GL_DEPTH_TEST);
+    }
+    else
+    {
+        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+    }
     glEnable(GL_CULL_FACE);
 
     while (!glfwWindowShouldClose(mWindow)) 
     {
+        AllocScope frameScope{ AllocSubsystem::Render };
         double currentTime = glfwGetTime();
         float deltaTime = float(currentTime - lastTime);
         lastTime = currentTime;
@@ -190,7 +240,7 @@ void Engine::Run()
         }
 
         glClearColor(0.39f, 0.58f, 0.93f, 1.00f);
-        glClear(GL_COLOR_BUFFER_BIT);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         
         ImGuiFrame();
 
@@ -201,6 +251,8 @@ void Engine::Run()
         ImGui::DragFloat4("Obj rotation", glm::value_ptr(objRotation), 0.01f);
         ImGui::End();
 
+        AllocationsPanel();
+
         // glm::mat4 translationMatrix = glm::translate(glm::mat4(1.0f), objPosition);
         // glm::mat4 scaleMatrix = glm::scale(glm::mat4(1.0f), glm::vec3{ 1.0f, 1.0f, 1.0f });
         // glm::mat4 rotationMatrix = glm::rotate(glm::mat4{1.0f}, rotationAngle, rotationAxis);
@@ -231,14 +283,77 @@ void Engine::Run()
             farClip                     // Far clipping plane. Keep as little as possible.
         );
 
-        const auto modelViewProjection = projectionMatrix * viewMatrix * modelMatrix;
-
         shader.Use();
-        shader.SetMatrix("mvp", modelViewProjection);
 
-        glBindVertexArray(mesh.GetVAO());
-        
-        glDrawElements(GL_TRIANGLES, mesh.GetIndicesCount(), GL_UNSIGNED_INT, nullptr);
+        if (chunked)
+        {
+            const auto chunkModel = modelMatrix * chunked->GetNormalizeMatrix();
+            chunked->Update(chunkModel, camera.GetPosition(), glm::radians(fieldOfView), winHeight);
+
+            shader.SetMatrix("mvp", projectionMatrix * viewMatrix * chunkModel);
+            chunked->Draw();
+
+            const auto& stats = chunked->GetStats();
+            float errorThreshold = chunked->GetErrorThreshold();
+
+            ImGui::Begin("Out-of-core");
+            if (ImGui::DragFloat("Error (px)", &errorThreshold, 0.1f, 0.1f, 100.0f))
+            {
+                chunked->SetErrorThreshold(errorThreshold);
+            }
+            ImGui::Text("Drawn: %u chunks, %u triangles", stats.drawnChunks, stats.drawnTriangles);
+            ImGui::Text("RAM: %.1f / %.1f MB", stats.ramBytes / 1048576.0, stats.ramBudget / 1048576.0);
+            ImGui::Text("VRAM: %.1f / %.1f MB", stats.vramBytes / 1048576.0, stats.vramBudget / 1048576.0);
+            ImGui::Text("Hit rate: %.1f%%", stats.GetHitRate() * 100.0);
+            ImGui::Text("Disk reads: %llu (%u pending), RAM hits: %llu",
+                static_cast<unsigned long long>(stats.diskReads), stats.pendingReads,
+                static_cast<unsigned long long>(stats.ramHits));
+            ImGui::Text("Evictions: %llu, deferred: %llu",
+                static_cast<unsigned long long>(stats.evictions),
+                static_cast<unsigned long long>(stats.deferred));
+            ImGui::Text("I/O: %.1f MB at %.1f MB/s", stats.bytesRead / 1048576.0, stats.GetReadThroughput());
+            ImGui::End();
+        }
+        else if (scene)
+        {
+            scene->Draw(sceneObjects, projectionMatrix * viewMatrix * modelMatrix);
+
+            const auto& stats = scene->GetStats();
+            bool indirect = scene->IsIndirect();
+
+            ImGui::Begin("Scene");
+            ImGui::BeginDisabled(!SceneRenderer::IsIndirectSupported());
+            if (ImGui::Checkbox("Multi-draw indirect", &indirect))
+            {
+                scene->SetIndirect(indirect);
+            }
+            ImGui::EndDisabled();
+            ImGui::Text("Objects: %u, visible: %u", stats.objects, stats.visible);
+            ImGui::Text("Draw calls: %u, triangles: %llu", stats.drawCalls, static_cast<unsigned long long>(stats.triangles));
+            ImGui::Text("Commands: %.3f ms on %u threads", stats.buildMs, scene->GetThreadCount());
+            ImGui::Text("Submit: %.3f ms", stats.submitMs);
+            ImGui::End();
+        }
+        else if (lit)
+        {
+            litShader.Use();
+            litShader.SetMatrix("mvp", projectionMatrix * viewMatrix * modelMatrix);
+            litShader.SetMatrix("modelView", viewMatrix * modelMatrix);
+
+            glBindVertexArray(mesh.GetVAO());
+
+            glDrawElements(GL_TRIANGLES, mesh.GetIndicesCount(), GL_UNSIGNED_INT, nullptr);
+        }
+        else
+        {
+            const auto modelViewProjection = projectionMatrix * viewMatrix * modelMatrix;
+            shader.SetMatrix("mvp", modelViewProjection);
+
+            glBindVertexArray(mesh.GetVAO());
+
+            glDrawElements(GL_TRIANGLES, mesh.GetIndicesCount(), GL_UNSIGNED_INT, nullptr);
+        }
+
         Render();
         glfwSwapBuffers(mWindow);
     }
@@ -253,6 +368,48 @@ void Engine::ImGuiFrame()
     ImGui::NewFrame();
 }
 
+void Engine::AllocationsPanel() 
+{
+    ImGui::Begin("Allocations");
+    if (!AllocTracker::IsEnabled())
+    {
+        ImGui::TextUnformatted("Configure with -DOBJ_LOADER_TRACK_ALLOCATIONS=ON");
+        ImGui::End();
+        return;
+    }
+
+    if (ImGui::BeginTable("allocations", 4, ImGuiTableFlags_Borders))
+    {
+        ImGui::TableSetupColumn("Subsystem");
+        ImGui::TableSetupColumn("Count");
+        ImGui::TableSetupColumn("Live MB");
+        ImGui::TableSetupColumn("Peak MB");
+        ImGui::TableHeadersRow();
+
+        const auto row = [](const char* name, const AllocCounters& counters)
+        {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(name);
+            ImGui::TableNextColumn();
+            ImGui::Text("%llu", static_cast<unsigned long long>(counters.count));
+            ImGui::TableNextColumn();
+            ImGui::Text("%.2f", counters.liveBytes / 1048576.0);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.2f", counters.peakBytes / 1048576.0);
+        };
+
+        for (size_t i = 0; i < static_cast<size_t>(AllocSubsystem::Count); ++i)
+        {
+            const auto subsystem = static_cast<AllocSubsystem>(i);
+            row(AllocTracker::GetName(subsystem), AllocTracker::Get(subsystem));
+        }
+        row("total", AllocTracker::GetTotal());
+        ImGui::EndTable();
+    }
+    ImGui::End();
+}
+
 void Engine::Render() 
 {
     ImGui::Render();
@@ -0,0 +1,46 @@
+#include "gl_context.hpp"
+
+#include <iostream>
+#include <system_error>
+
+#include <glad/gl.h>
+#include <GLFW/glfw3.h>
+
+static
+GLFWwindow* TryCreate(int width, int height, const char* title, bool visible, int major, int minor)
+{
+	glfwDefaultWindowHints();
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, major);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, minor);
+	glfwWindowHint(GLFW_VISIBLE, visible ? GLFW_TRUE : GLFW_FALSE);
+	if (major > 3)
+	{
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	}
+	return glfwCreateWindow(width, height, title, nullptr, nullptr);
+}
+
+GLFWwindow* CreateGLWindow(int width, int height, const char* title, bool visible, bool preferModern)
+{
+	GLFWwindow* window = preferModern ? TryCreate(width, height, title, visible, 4, 3) : nullptr;
+	if (!window)
+	{
+		window = TryCreate(width, height, title, visible, 3, 3);
+	}
+	if (!window)
+	{
+		std::cerr << "Error creating glfw3 window\n";
+		throw std::system_error(std::error_code(), "Error creating glfw3 window");
+	}
+
+	glfwMakeContextCurrent(window);
+
+	int version = gladLoadGL(glfwGetProcAddress);
+	if (version == 0)
+	{
+		std::cerr << "Failed to initialize GLAD\n";
+		glfwDestroyWindow(window);
+		throw std::system_error(std::error_code(), "Error initializing glad");
+	}
+	return window;
+}
@@ -1,8 +1,52 @@
 ﻿#include "engine.hpp"
 
-int main()
+#include <cstdlib>
+#include <string_view>
+
+// usage: obj_loader [mesh.obj | mesh.meshbin | chunk directory] [--ram-mb <n>] [--vram-mb <n>]
+//                   [--grid <n>] [--no-indirect] [--normals [degrees]]
+int main(int argc, char** argv)
 {
-    Engine engine(1024, 768);
+    EngineOptions options;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string_view arg = argv[i];
+        if (arg == "--ram-mb" && i + 1 < argc)
+        {
+            options.ramBudget = std::strtoull(argv[++i], nullptr, 10) << 20;
+        }
+        else if (arg == "--vram-mb" && i + 1 < argc)
+        {
+            options.vramBudget = std::strtoull(argv[++i], nullptr, 10) << 20;
+        }
+        else if (arg == "--grid" && i + 1 < argc)
+        {
+            options.gridSize = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--no-indirect")
+        {
+            options.indirect = false;
+        }
+        else if (arg == "--normals")
+        {
+            options.normals = true;
+
+            // The crease angle is optional, only take the next argument when it is a number
+            char* end = nullptr;
+            const float angle = i + 1 < argc ? std::strtof(argv[i + 1], &end) : 0.0f;
+            if (end && end != argv[i + 1] && *end == '\0')
+            {
+                options.creaseAngle = angle;
+                ++i;
+            }
+        }
+        else
+        {
+            options.meshPath = arg;
+        }
+    }
+
+    Engine engine(1024, 768, options);
     engine.Run();
     return 0;
 }
\ No newline at end of file
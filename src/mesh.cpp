@@ -1,5 +1,6 @@
 #include "mesh.hpp"
 
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <exception>
@@ -7,43 +8,107 @@
 #include <vector>
 #include <cmath>
 #include <cfloat>
+#include <cstddef>
+#include <climits>
+
+#include "alloc_tracker.hpp"
+#include "mesh_io.hpp"
+#include "mesh_processing.hpp"
+#include "obj_records.hpp"
+
+// Record counts from a quick pass over the raw bytes, used to size the arena
+struct ObjCounts
+{
+	size_t vertices = 0;
+	size_t texCoords = 0;
+	size_t faces = 0;
+	size_t corners = 0;
+	size_t smoothingGroups = 0;
+};
 
 static
-std::vector<std::string_view> tokenize(std::string_view s, std::string_view del = " ") 
+ObjCounts ScanObj(std::ifstream& ifs)
 {
-	std::vector<std::string_view> res;
-	size_t start = 0, end = -1 * del.size();
-	do 
+	ObjCounts counts;
+	char block[1 << 16];
+	size_t column = 0;
+	char type = 0;
+	bool inToken = false;
+
+	while (ifs.read(block, sizeof block) || ifs.gcount() > 0)
 	{
-		start = end + del.size();
-		end = s.find(del, start);
+		for (std::streamsize i = 0; i < ifs.gcount(); ++i)
+		{
+			const char c = block[i];
+			if (c == '\n')
+			{
+				column = 0;
+				type = 0;
+				inToken = false;
+				continue;
+			}
 
-		res.emplace_back(s.substr(start, end - start));
-	} 
-	while (end != -1);
-	return res;
-}
+			const bool space = c == ' ' || c == '\t' || c == '\r';
+			if (column == 0)
+			{
+				type = c;
+			}
+			else if (column == 1 && type == 'v' && c == 't')
+			{
+				type = 't';
+			}
+			else if (column == 1 || (column == 2 && type == 't'))
+			{
+				if (!space)
+				{
+					type = 0;	// vn and friends
+				}
+				else if (type == 'v')
+				{
+					++counts.vertices;
+				}
+				else if (type == 't')
+				{
+					++counts.texCoords;
+				}
+				else if (type == 'f')
+				{
+					++counts.faces;
+				}
+				else if (type == 's')
+				{
+					++counts.smoothingGroups;
+				}
+				type = type == 'f' ? type : 0;
+			}
+			else if (type == 'f')
+			{
+				counts.corners += !space && !inToken;
+				inToken = !space;
+			}
+			++column;
+		}
+	}
 
-static
-std::string_view ltrim(std::string_view s) 
-{
-	s.remove_prefix(std::distance(s.cbegin(), std::find_if(s.cbegin(), s.cend(),
-		[](int c) {return !std::isspace(c); })));
-	return s;
+	ifs.clear();
+	ifs.seekg(0);
+	return counts;
 }
 
-static
-std::string_view rtrim(std::string_view s) 
+MeshData::MeshData() 
 {
-	s.remove_suffix(std::distance(s.crbegin(), std::find_if(s.crbegin(), s.crend(),
-		[](int c) {return !std::isspace(c); })));
-	return s;
 }
 
-static
-std::string_view trim(std::string_view s) 
+MeshData::MeshData(size_t arenaBytes) 
+	: arena{ std::make_shared<std::pmr::monotonic_buffer_resource>(std::max<size_t>(arenaBytes, 1)) },
+	vertices{ arena.get() },
+	indices{ arena.get() },
+	faceSizes{ arena.get() },
+	texCoords{ arena.get() },
+	normals{ arena.get() },
+	tangents{ arena.get() },
+	smoothingGroups{ arena.get() }
 {
-	return ltrim(rtrim(s));
 }
 
 Mesh::Mesh() 
@@ -53,47 +118,161 @@ Mesh::Mesh()
 
 void Mesh::Load(const char* name) 
 {
-	// Only load mesh without textures
-	std::vector<glm::vec3> vertices;
-	std::vector<unsigned int> indices;
+	// Texture coordinates are parsed but only positions and normals are uploaded
+	Upload(Prepare(name));
+}
 
-	std::ifstream ifs{ name };
-	if (ifs.bad()) 
+MeshData Mesh::Prepare(const char* name) 
+{
+	auto data = Parse(name);
+
+	AllocScope scope{ AllocSubsystem::MeshProcessing };
+	Triangulate(data);
+
+	Center(data.vertices);
+	Normalize(data.vertices);
+	return data;
+}
+
+MeshData Mesh::Parse(const char* name) 
+{
+	AllocScope scope{ AllocSubsystem::MeshLoad };
+	if (IsMeshCache(name)) 
+	{
+		return ReadMeshCache(name);
+	}
+
+	std::ifstream ifs{ name, std::ios::binary };
+	if (!ifs.good()) 
 	{
 		throw std::runtime_error("Error loading mesh");
 	}
 
-	while (!ifs.eof()) 
+	// Size everything up front so that the arrays never reallocate. Textured
+	// meshes get a vertex per distinct position and texture coordinate pair,
+	// which is usually about one per texture coordinate. The scratch arrays
+	// for the split get their own arena, released when parsing is done.
+	const auto counts = ScanObj(ifs);
+	const bool textured = counts.texCoords > 0;
+	const auto vertexCount = textured ? std::max(counts.vertices, counts.texCoords) : counts.vertices;
+	const auto scratchBytes = textured ?
+		counts.vertices * (sizeof(glm::vec3) + sizeof(unsigned int)) + 
+		counts.texCoords * sizeof(glm::vec2) + 
+		vertexCount * 2 * sizeof(unsigned int) : 0;
+	MeshData data{ 
+		vertexCount * (sizeof(glm::vec3) + (textured ? sizeof(glm::vec2) : 0)) + 
+		(counts.corners + counts.faces) * sizeof(unsigned int) + 
+		(counts.smoothingGroups ? counts.faces * sizeof(unsigned int) : 0) + 
+		5 * alignof(std::max_align_t) 
+	};
+	std::pmr::monotonic_buffer_resource scratch{ scratchBytes + 5 * alignof(std::max_align_t) };
+
+	auto& vertices = data.vertices;
+	auto& indices = data.indices;
+	auto& faceSizes = data.faceSizes;
+	vertices.reserve(vertexCount);
+	indices.reserve(counts.corners);
+	faceSizes.reserve(counts.faces);
+	data.texCoords.reserve(textured ? vertexCount : 0);
+	data.smoothingGroups.reserve(counts.smoothingGroups ? counts.faces : 0);
+
+	// Textured corners are split by pair. The vertices of every position form
+	// a chain through nextSplit starting at firstVertex, each tagged with its
+	// texture coordinate + 1 so that kNoTexCoord wraps to 0.
+	std::pmr::vector<glm::vec3> positions{ &scratch };
+	std::pmr::vector<glm::vec2> texCoords{ &scratch };
+	std::pmr::vector<unsigned int> firstVertex{ &scratch };
+	std::pmr::vector<unsigned int> vertexTexCoord{ &scratch };
+	std::pmr::vector<unsigned int> nextSplit{ &scratch };
+	if (textured)
 	{
-		std::string line;
-		ifs >> line;
+		positions.reserve(counts.vertices);
+		texCoords.reserve(counts.texCoords);
+		firstVertex.reserve(counts.vertices);
+		vertexTexCoord.reserve(vertexCount);
+		nextSplit.reserve(vertexCount);
+	}
 
-		if (line == "v") 
+	const auto addCorner = [&](uint64_t index, uint64_t texCoord) 
+	{
+		if (!textured)
 		{
-			float arr[3]{};
-			ifs >> arr[0] >> arr[1] >> arr[2];
-			vertices.emplace_back(glm::vec3{ arr[0], arr[1], arr[2] });
+			indices.emplace_back(static_cast<unsigned int>(index));
+			return;
 		}
-		else if (line == "f") 
+
+		// Texture coordinate indices fit in 32 bits
+		const auto tag = static_cast<unsigned int>(texCoord + 1);
+		auto vertex = firstVertex[index];
+		while (vertex != UINT_MAX && vertexTexCoord[vertex] != tag)
 		{
-			std::getline(ifs, line);
+			vertex = nextSplit[vertex];
+		}
 
-			for (auto v : tokenize(trim(line))) 
+		if (vertex == UINT_MAX)
+		{
+			vertex = static_cast<unsigned int>(vertices.size());
+			vertices.emplace_back(positions[index]);
+			data.texCoords.emplace_back(texCoord == kNoTexCoord ? glm::vec2{} : texCoords[texCoord]);
+			vertexTexCoord.emplace_back(tag);
+			nextSplit.emplace_back(firstVertex[index]);
+			firstVertex[index] = vertex;
+		}
+		indices.emplace_back(vertex);
+	};
+
+	bool trianglesOnly = true;
+	unsigned int smoothingGroup = 0;
+	std::string line;
+	while (std::getline(ifs, line)) 
+	{
+		if (const char* s = MatchRecord(line, "v")) 
+		{
+			if (textured)
 			{
-				// 1 set of indices/vtx tex coord indices/vtx normal indices
-				auto token = tokenize(v, "/");
-				const auto id = atoi(token[0].data()) - 1;	// index start with 0
-				indices.emplace_back(id);
+				positions.emplace_back(ParseVertex(s));
+				firstVertex.emplace_back(UINT_MAX);
 			}
+			else
+			{
+				vertices.emplace_back(ParseVertex(s));
+			}
+		}
+		else if (const char* s = MatchRecord(line, "vt")) 
+		{
+			texCoords.emplace_back(ParseTexCoord(s));
+		}
+		else if (const char* s = MatchRecord(line, "s")) 
+		{
+			smoothingGroup = ParseSmoothingGroup(s);
 		}
-		else 
+		else if (const char* s = MatchRecord(line, "f")) 
 		{
-			std::getline(ifs, line);
+			// 1 set of indices/vtx tex coord indices/vtx normal indices, normals are generated instead
+			const auto first = indices.size();
+			ParseFace(s, textured ? positions.size() : vertices.size(), texCoords.size(), addCorner);
+
+			const auto corners = static_cast<unsigned int>(indices.size() - first);
+			faceSizes.emplace_back(corners);
+			trianglesOnly = trianglesOnly && corners == 3;
+			if (counts.smoothingGroups)
+			{
+				data.smoothingGroups.emplace_back(smoothingGroup);
+			}
 		}
 	}
 
-	Center(vertices);
-	Normalize(vertices);
+	if (trianglesOnly)
+	{
+		faceSizes.clear();
+	}
+	return data;
+}
+
+void Mesh::Upload(const MeshData& data) 
+{
+	const auto& vertices = data.vertices;
+	const auto& indices = data.indices;
 
 	mCount = static_cast<GLsizei>(indices.size());
 
@@ -108,6 +287,17 @@ void Mesh::Load(const char* name)
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
 	glEnableVertexAttribArray(0);
 
+	if (!data.normals.empty())
+	{
+		GLuint normals;
+		glGenBuffers(1, &normals);
+		glBindBuffer(GL_ARRAY_BUFFER, normals);
+		glBufferData(GL_ARRAY_BUFFER, data.normals.size() * sizeof data.normals[0], data.normals.data(), GL_STATIC_DRAW);
+
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+		glEnableVertexAttribArray(1);
+	}
+
 	GLuint ebo;
 	glGenBuffers(1, &ebo);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
@@ -116,7 +306,7 @@ void Mesh::Load(const char* name)
 	glBindVertexArray(0);
 }
 
-void Mesh::Center(std::vector<glm::vec3> &vertices) const 
+void Mesh::Center(std::pmr::vector<glm::vec3> &vertices) 
 {
 	// Center the mesh
 	glm::vec3 all{};
@@ -131,7 +321,7 @@ void Mesh::Center(std::vector<glm::vec3> &vertices) const
 	}
 }
 
-void Mesh::Normalize(std::vector<glm::vec3>& vertices) const {
+void Mesh::Normalize(std::pmr::vector<glm::vec3>& vertices) {
 	auto xDiff = std::make_pair(FLT_MAX, FLT_MIN);
 	auto yDiff = std::make_pair(FLT_MAX, FLT_MIN);
 	auto zDiff = std::make_pair(FLT_MAX, FLT_MIN);
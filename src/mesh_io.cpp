@@ -0,0 +1,428 @@
+#include "mesh_io.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Everything is written in host byte order, which is little endian on every
+// platform we build for, as required by glTF and the PLY format we declare.
+
+static constexpr char kCacheMagic[4] = { 'O', 'M', 'S', 'H' };
+static constexpr uint32_t kCacheVersion = 2;
+static constexpr const char* kCacheExtension = ".meshbin";
+
+struct CacheHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint64_t vertexCount;
+	uint64_t indexCount;
+	uint64_t faceCount;
+
+	// Version 2, the optional attribute arrays
+	uint64_t texCoordCount;
+	uint64_t normalCount;
+	uint64_t tangentCount;
+	uint64_t smoothingGroupCount;
+};
+
+// Version 1 files stop after faceCount
+static constexpr size_t kCacheHeaderV1Size = offsetof(CacheHeader, texCoordCount);
+
+template <typename T>
+static
+void WriteArray(std::ofstream& ofs, const std::pmr::vector<T>& values)
+{
+	ofs.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+}
+
+template <typename T>
+static
+void ReadArray(std::ifstream& ifs, std::pmr::vector<T>& values, uint64_t count)
+{
+	values.resize(count);
+	ifs.read(reinterpret_cast<char*>(values.data()), count * sizeof(T));
+}
+
+static
+std::ofstream OpenOutput(const std::filesystem::path& path)
+{
+	std::ofstream ofs{ path, std::ios::binary };
+	if (!ofs.good())
+	{
+		throw std::runtime_error("Error opening " + path.string() + " for writing");
+	}
+	return ofs;
+}
+
+bool IsMeshCache(const std::filesystem::path& path)
+{
+	return path.extension() == kCacheExtension;
+}
+
+MeshData ReadMeshCache(const std::filesystem::path& path)
+{
+	std::ifstream ifs{ path, std::ios::binary };
+	if (!ifs.good())
+	{
+		throw std::runtime_error("Error loading mesh cache");
+	}
+
+	CacheHeader header{};
+	ifs.read(reinterpret_cast<char*>(&header), kCacheHeaderV1Size);
+	if (!ifs.good() || std::memcmp(header.magic, kCacheMagic, sizeof kCacheMagic) != 0)
+	{
+		throw std::runtime_error("Not a mesh cache: " + path.string());
+	}
+	if (header.version == 0 || header.version > kCacheVersion)
+	{
+		throw std::runtime_error("Unsupported mesh cache version: " + path.string());
+	}
+	if (header.version >= 2)
+	{
+		ifs.read(reinterpret_cast<char*>(&header) + kCacheHeaderV1Size, sizeof header - kCacheHeaderV1Size);
+	}
+
+	// Check the counts against the file before anything is sized from them
+	const uint64_t fileBytes = std::filesystem::file_size(path);
+	const uint64_t counts[] = {
+		header.vertexCount, header.indexCount, header.faceCount, header.texCoordCount,
+		header.normalCount, header.tangentCount, header.smoothingGroupCount
+	};
+	if (std::any_of(std::begin(counts), std::end(counts), [&](uint64_t count) { return count > fileBytes; }))
+	{
+		throw std::runtime_error("Truncated mesh cache: " + path.string());
+	}
+
+	const uint64_t arrayBytes =
+		header.vertexCount * sizeof(glm::vec3) + 
+		(header.indexCount + header.faceCount) * sizeof(uint32_t) + 
+		header.texCoordCount * sizeof(glm::vec2) +
+		header.normalCount * sizeof(glm::vec3) +
+		header.tangentCount * sizeof(glm::vec4) +
+		header.smoothingGroupCount * sizeof(uint32_t);
+	const uint64_t headerBytes = header.version >= 2 ? sizeof header : kCacheHeaderV1Size;
+	if (headerBytes + arrayBytes != fileBytes)
+	{
+		throw std::runtime_error("Truncated mesh cache: " + path.string());
+	}
+
+	// Reject what the OBJ parser would have rejected, the stages index with these unchecked
+	const auto perVertex = [&](uint64_t count) { return count == 0 || count == header.vertexCount; };
+	if (!perVertex(header.texCoordCount) || !perVertex(header.normalCount) || !perVertex(header.tangentCount))
+	{
+		throw std::runtime_error("Mesh cache attributes do not match its vertices: " + path.string());
+	}
+
+	const auto faceCount = header.faceCount ? header.faceCount : header.indexCount / 3;
+	if ((header.faceCount == 0 && header.indexCount % 3 != 0) || 
+		(header.smoothingGroupCount != 0 && header.smoothingGroupCount != faceCount))
+	{
+		throw std::runtime_error("Mesh cache faces do not match its indices: " + path.string());
+	}
+
+	MeshData data{ arrayBytes + 7 * alignof(std::max_align_t) };
+	ReadArray(ifs, data.vertices, header.vertexCount);
+	ReadArray(ifs, data.indices, header.indexCount);
+	ReadArray(ifs, data.faceSizes, header.faceCount);
+	ReadArray(ifs, data.texCoords, header.texCoordCount);
+	ReadArray(ifs, data.normals, header.normalCount);
+	ReadArray(ifs, data.tangents, header.tangentCount);
+	ReadArray(ifs, data.smoothingGroups, header.smoothingGroupCount);
+	if (!ifs.good())
+	{
+		throw std::runtime_error("Truncated mesh cache: " + path.string());
+	}
+
+	uint64_t corners = 0;
+	for (auto size : data.faceSizes)
+	{
+		corners += size;
+	}
+	if (header.faceCount != 0 && corners != header.indexCount)
+	{
+		throw std::runtime_error("Mesh cache faces do not match its indices: " + path.string());
+	}
+	if (std::any_of(data.indices.begin(), data.indices.end(), [&](uint32_t index) { return index >= header.vertexCount; }))
+	{
+		throw std::runtime_error("Mesh cache references a missing vertex: " + path.string());
+	}
+	return data;
+}
+
+void WriteMeshCache(const std::filesystem::path& path, const MeshData& data)
+{
+	CacheHeader header{};
+	std::memcpy(header.magic, kCacheMagic, sizeof kCacheMagic);
+	header.version = kCacheVersion;
+	header.vertexCount = data.vertices.size();
+	header.indexCount = data.indices.size();
+	header.faceCount = data.faceSizes.size();
+	header.texCoordCount = data.texCoords.size();
+	header.normalCount = data.normals.size();
+	header.tangentCount = data.tangents.size();
+	header.smoothingGroupCount = data.smoothingGroups.size();
+
+	auto ofs = OpenOutput(path);
+	ofs.write(reinterpret_cast<const char*>(&header), sizeof header);
+	WriteArray(ofs, data.vertices);
+	WriteArray(ofs, data.indices);
+	WriteArray(ofs, data.faceSizes);
+	WriteArray(ofs, data.texCoords);
+	WriteArray(ofs, data.normals);
+	WriteArray(ofs, data.tangents);
+	WriteArray(ofs, data.smoothingGroups);
+}
+
+// One vertex attribute of the glTF buffer
+struct GltfAttribute
+{
+	const char* name;
+	const char* type;
+	const void* data;
+	size_t count;
+	size_t bytes;
+};
+
+template <typename T>
+static
+void AddGltfAttribute(std::vector<GltfAttribute>& attributes, const char* name, const char* type, const std::pmr::vector<T>& values)
+{
+	if (!values.empty())
+	{
+		attributes.push_back({ name, type, values.data(), values.size(), values.size() * sizeof(T) });
+	}
+}
+
+// Percent-encodes everything but the unreserved characters of RFC 3986, which
+// also leaves nothing to escape in the JSON string the uri is written to
+static
+std::string EncodeGltfUri(const std::filesystem::path& name)
+{
+	static constexpr char kHex[] = "0123456789ABCDEF";
+	std::string uri;
+	for (const auto c : name.u8string())
+	{
+		const auto byte = static_cast<unsigned char>(c);
+		const bool unreserved = (byte >= 'A' && byte <= 'Z') || (byte >= 'a' && byte <= 'z') || (byte >= '0' && byte <= '9') ||
+			byte == '-' || byte == '.' || byte == '_' || byte == '~';
+		if (unreserved)
+		{
+			uri += static_cast<char>(byte);
+		}
+		else
+		{
+			uri += '%';
+			uri += kHex[byte >> 4];
+			uri += kHex[byte & 15];
+		}
+	}
+	return uri;
+}
+
+static
+void WriteGltfBuffer(std::ofstream& ofs, const std::vector<GltfAttribute>& attributes, const MeshData& data)
+{
+	for (const auto& attribute : attributes)
+	{
+		ofs.write(static_cast<const char*>(attribute.data), attribute.bytes);
+	}
+	WriteArray(ofs, data.indices);
+}
+
+void WriteGltf(const std::filesystem::path& path, const MeshData& data, bool binary)
+{
+	if (!data.faceSizes.empty())
+	{
+		throw std::runtime_error("glTF export requires a triangulated mesh");
+	}
+	if (data.vertices.empty() || data.indices.empty())
+	{
+		// glTF does not allow the empty buffer views such a mesh would need
+		throw std::runtime_error("glTF export requires at least one triangle");
+	}
+
+	glm::vec3 lower{ FLT_MAX }, upper{ -FLT_MAX };
+	for (const auto& v : data.vertices)
+	{
+		lower = glm::min(lower, v);
+		upper = glm::max(upper, v);
+	}
+
+	// glTF puts the texture origin at the top left, flipping v mirrors the
+	// mapping and with it the bitangent sign
+	std::pmr::vector<glm::vec2> texCoords{ data.texCoords };
+	for (auto& texCoord : texCoords)
+	{
+		texCoord.y = 1.0f - texCoord.y;
+	}
+	std::pmr::vector<glm::vec4> tangents{ data.tangents };
+	for (auto& tangent : tangents)
+	{
+		tangent.w = -tangent.w;
+	}
+
+	std::vector<GltfAttribute> attributes;
+	AddGltfAttribute(attributes, "POSITION", "VEC3", data.vertices);
+	AddGltfAttribute(attributes, "NORMAL", "VEC3", data.normals);
+	AddGltfAttribute(attributes, "TANGENT", "VEC4", tangents);
+	AddGltfAttribute(attributes, "TEXCOORD_0", "VEC2", texCoords);
+
+	const size_t indexBytes = data.indices.size() * sizeof data.indices[0];
+	size_t bufferBytes = indexBytes;
+	for (const auto& attribute : attributes)
+	{
+		bufferBytes += attribute.bytes;
+	}
+
+	auto binPath = path;
+	binPath.replace_extension(".bin");
+
+	// One buffer, every attribute followed by the indices, all already 4 byte aligned.
+	// Attribute i uses buffer view and accessor i, the indices come last.
+	std::ostringstream json;
+	json << std::setprecision(9)
+		<< "{\"asset\":{\"version\":\"2.0\",\"generator\":\"obj_convert\"},"
+		<< "\"scene\":0,\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"mesh\":0}],"
+		<< "\"meshes\":[{\"primitives\":[{\"attributes\":{";
+	for (size_t i = 0; i < attributes.size(); ++i)
+	{
+		json << (i ? "," : "") << "\"" << attributes[i].name << "\":" << i;
+	}
+	json << "},\"indices\":" << attributes.size() << ",\"mode\":4}]}],"
+		<< "\"buffers\":[{\"byteLength\":" << bufferBytes;
+	if (!binary)
+	{
+		json << ",\"uri\":\"" << EncodeGltfUri(binPath.filename()) << "\"";
+	}
+	json << "}],\"bufferViews\":[";
+
+	size_t offset = 0;
+	for (const auto& attribute : attributes)
+	{
+		json << "{\"buffer\":0,\"byteOffset\":" << offset << ",\"byteLength\":" << attribute.bytes << ",\"target\":34962},";
+		offset += attribute.bytes;
+	}
+	json << "{\"buffer\":0,\"byteOffset\":" << offset << ",\"byteLength\":" << indexBytes << ",\"target\":34963}],"
+		<< "\"accessors\":[";
+
+	for (size_t i = 0; i < attributes.size(); ++i)
+	{
+		json << "{\"bufferView\":" << i << ",\"componentType\":5126,\"count\":" << attributes[i].count
+			<< ",\"type\":\"" << attributes[i].type << "\"";
+		if (i == 0)
+		{
+			json << ",\"min\":[" << lower.x << "," << lower.y << "," << lower.z << "],"
+				<< "\"max\":[" << upper.x << "," << upper.y << "," << upper.z << "]";
+		}
+		json << "},";
+	}
+	json << "{\"bufferView\":" << attributes.size() << ",\"componentType\":5125,\"count\":" << data.indices.size() << ",\"type\":\"SCALAR\"}]}";
+
+	if (!binary)
+	{
+		auto ofs = OpenOutput(path);
+		ofs << json.str();
+
+		auto bin = OpenOutput(binPath);
+		WriteGltfBuffer(bin, attributes, data);
+		return;
+	}
+
+	// GLB container: header, JSON chunk padded with spaces, BIN chunk padded with zeros
+	auto text = json.str();
+	text.resize((text.size() + 3) & ~size_t{ 3 }, ' ');
+	const uint32_t binLength = static_cast<uint32_t>((bufferBytes + 3) & ~size_t{ 3 });
+
+	const uint32_t header[3] = {
+		0x46546C67,	// "glTF"
+		2,
+		static_cast<uint32_t>(12 + 8 + text.size() + 8 + binLength)
+	};
+	const uint32_t jsonChunk[2] = { static_cast<uint32_t>(text.size()), 0x4E4F534A };	// "JSON"
+	const uint32_t binChunk[2] = { binLength, 0x004E4942 };	// "BIN"
+
+	auto ofs = OpenOutput(path);
+	ofs.write(reinterpret_cast<const char*>(header), sizeof header);
+	ofs.write(reinterpret_cast<const char*>(jsonChunk), sizeof jsonChunk);
+	ofs.write(text.data(), text.size());
+	ofs.write(reinterpret_cast<const char*>(binChunk), sizeof binChunk);
+	WriteGltfBuffer(ofs, attributes, data);
+	for (size_t i = bufferBytes; i < binLength; ++i)
+	{
+		ofs.put('\0');
+	}
+}
+
+void WritePly(const std::filesystem::path& path, const MeshData& data)
+{
+	const bool trianglesOnly = data.faceSizes.empty();
+	const size_t faceCount = trianglesOnly ? data.indices.size() / 3 : data.faceSizes.size();
+
+	auto ofs = OpenOutput(path);
+	ofs << "ply\n"
+		<< "format binary_little_endian 1.0\n"
+		<< "comment generated by obj_convert\n"
+		<< "element vertex " << data.vertices.size() << "\n"
+		<< "property float x\n"
+		<< "property float y\n"
+		<< "property float z\n";
+	if (!data.normals.empty())
+	{
+		ofs << "property float nx\n"
+			<< "property float ny\n"
+			<< "property float nz\n";
+	}
+	if (!data.texCoords.empty())
+	{
+		ofs << "property float s\n"
+			<< "property float t\n";
+	}
+	ofs << "element face " << faceCount << "\n"
+		<< "property list uchar uint vertex_indices\n"
+		<< "end_header\n";
+
+	if (data.normals.empty() && data.texCoords.empty())
+	{
+		WriteArray(ofs, data.vertices);
+	}
+	else
+	{
+		// PLY vertices are interleaved
+		for (size_t v = 0; v < data.vertices.size(); ++v)
+		{
+			ofs.write(reinterpret_cast<const char*>(&data.vertices[v]), sizeof data.vertices[v]);
+			if (!data.normals.empty())
+			{
+				ofs.write(reinterpret_cast<const char*>(&data.normals[v]), sizeof data.normals[v]);
+			}
+			if (!data.texCoords.empty())
+			{
+				ofs.write(reinterpret_cast<const char*>(&data.texCoords[v]), sizeof data.texCoords[v]);
+			}
+		}
+	}
+
+	size_t offset = 0;
+	for (size_t f = 0; f < faceCount; ++f)
+	{
+		const auto corners = trianglesOnly ? 3u : data.faceSizes[f];
+		if (corners > UINT8_MAX)
+		{
+			throw std::runtime_error("PLY export only supports faces with up to 255 corners");
+		}
+
+		const auto count = static_cast<uint8_t>(corners);
+		ofs.write(reinterpret_cast<const char*>(&count), sizeof count);
+		ofs.write(reinterpret_cast<const char*>(data.indices.data() + offset), corners * sizeof data.indices[0]);
+		offset += corners;
+	}
+}
@@ -0,0 +1,465 @@
+#include "mesh_processing.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+static constexpr int kVertexCacheSize = 32;
+
+struct CellKey
+{
+	int64_t x, y, z;
+
+	bool operator==(const CellKey& other) const = default;
+};
+
+struct CellKeyHash
+{
+	size_t operator()(const CellKey& key) const
+	{
+		return HashCoordinates(static_cast<uint64_t>(key.x), static_cast<uint64_t>(key.y), static_cast<uint64_t>(key.z));
+	}
+};
+
+static
+CellKey MakeCellKey(const glm::vec3& v, const glm::vec3& origin, float cellSize)
+{
+	if (cellSize <= 0.0f)
+	{
+		return CellKey{ ExactBits(v.x), ExactBits(v.y), ExactBits(v.z) };
+	}
+
+	return CellKey{
+		static_cast<int64_t>(std::floor((v.x - origin.x) / cellSize)),
+		static_cast<int64_t>(std::floor((v.y - origin.y) / cellSize)),
+		static_cast<int64_t>(std::floor((v.z - origin.z) / cellSize))
+	};
+}
+
+// Assign every vertex to a grid cell, returns the number of cells in use
+static
+unsigned int ClusterVertices(std::span<const glm::vec3> vertices, const glm::vec3& origin, float cellSize, std::vector<unsigned int>& cluster)
+{
+	std::unordered_map<CellKey, unsigned int, CellKeyHash> cells;
+	cells.reserve(vertices.size());
+	cluster.resize(vertices.size());
+
+	for (size_t i = 0; i < vertices.size(); ++i)
+	{
+		auto [it, inserted] = cells.try_emplace(MakeCellKey(vertices[i], origin, cellSize), static_cast<unsigned int>(cells.size()));
+		cluster[i] = it->second;
+	}
+	return static_cast<unsigned int>(cells.size());
+}
+
+// Stages build their results in scratch arrays on the heap and copy them back,
+// so results that shrink reuse the storage they already own in the load arena.
+// Stages that grow arrays (Triangulate, and the tangent space generator for
+// split vertices and new normals and tangents) work out the final size first
+// and allocate each array from the arena once, leaving one dead block behind.
+
+// Rebuild every per vertex array from the listed source vertices, in order
+static
+void GatherVertices(MeshData& data, std::span<const unsigned int> source)
+{
+	const auto gather = [source](auto& values)
+	{
+		if (values.empty())
+		{
+			return;
+		}
+
+		std::vector<typename std::decay_t<decltype(values)>::value_type> result(source.size());
+		for (size_t i = 0; i < source.size(); ++i)
+		{
+			result[i] = values[source[i]];
+		}
+		values.assign(result.begin(), result.end());
+	};
+
+	gather(data.vertices);
+	gather(data.texCoords);
+	gather(data.normals);
+	gather(data.tangents);
+}
+
+// Renumber vertices in the order they are first referenced and drop the unused ones
+static
+void CompactVertices(MeshData& data)
+{
+	std::vector<unsigned int> remap(data.vertices.size(), UINT_MAX);
+	std::vector<unsigned int> source;
+	source.reserve(data.vertices.size());
+
+	for (auto& index : data.indices)
+	{
+		if (remap[index] == UINT_MAX)
+		{
+			remap[index] = static_cast<unsigned int>(source.size());
+			source.emplace_back(index);
+		}
+		index = remap[index];
+	}
+	GatherVertices(data, source);
+}
+
+static
+float VertexScore(int cachePosition, unsigned int remainingTriangles)
+{
+	if (remainingTriangles == 0)
+	{
+		return -1.0f;
+	}
+
+	float score = 0.0f;
+	if (cachePosition >= 0)
+	{
+		// The last triangle's vertices get a fixed score so that strips are not favoured
+		if (cachePosition < 3)
+		{
+			score = 0.75f;
+		}
+		else
+		{
+			const float scaler = 1.0f / (kVertexCacheSize - 3);
+			score = std::pow(1.0f - (cachePosition - 3) * scaler, 1.5f);
+		}
+	}
+
+	// Boost vertices with few triangles left so that they get finished off
+	score += 2.0f * std::pow(static_cast<float>(remainingTriangles), -0.5f);
+	return score;
+}
+
+void Triangulate(MeshData& data)
+{
+	if (data.faceSizes.empty())
+	{
+		return;
+	}
+
+	size_t count = 0;
+	for (auto corners : data.faceSizes)
+	{
+		count += corners >= 3 ? (corners - 2) * 3 : 0;
+	}
+
+	std::pmr::vector<unsigned int> triangles{ data.indices.get_allocator() };
+	std::pmr::vector<unsigned int> groups{ data.smoothingGroups.get_allocator() };
+	triangles.reserve(count);
+	groups.reserve(data.smoothingGroups.empty() ? 0 : count / 3);
+
+	size_t offset = 0;
+	for (size_t face = 0; face < data.faceSizes.size(); ++face)
+	{
+		const auto corners = data.faceSizes[face];
+		for (unsigned int i = 1; i + 1 < corners; ++i)
+		{
+			triangles.emplace_back(data.indices[offset]);
+			triangles.emplace_back(data.indices[offset + i]);
+			triangles.emplace_back(data.indices[offset + i + 1]);
+			if (!data.smoothingGroups.empty())
+			{
+				groups.emplace_back(data.smoothingGroups[face]);
+			}
+		}
+		offset += corners;
+	}
+
+	data.indices = std::move(triangles);
+	data.smoothingGroups = std::move(groups);
+	data.faceSizes.clear();
+}
+
+void WeldVertices(MeshData& data, float epsilon)
+{
+	std::vector<unsigned int> cluster;
+	auto count = ClusterVertices(data.vertices, glm::vec3{}, epsilon, cluster);
+
+	// Texture seams stay open, only vertices with the same texture coordinate merge
+	if (!data.texCoords.empty())
+	{
+		std::unordered_map<CellKey, unsigned int, CellKeyHash> seams;
+		seams.reserve(data.vertices.size());
+		for (size_t i = 0; i < data.vertices.size(); ++i)
+		{
+			const CellKey key{
+				cluster[i],
+				ExactBits(data.texCoords[i].x),
+				ExactBits(data.texCoords[i].y)
+			};
+			cluster[i] = seams.try_emplace(key, static_cast<unsigned int>(seams.size())).first->second;
+		}
+		count = static_cast<unsigned int>(seams.size());
+	}
+
+	if (count == data.vertices.size())
+	{
+		return;
+	}
+
+	// Keep the first vertex of every cell, generated normals no longer fit
+	std::vector<unsigned int> source(count);
+	for (size_t i = data.vertices.size(); i-- > 0;)
+	{
+		source[cluster[i]] = static_cast<unsigned int>(i);
+	}
+
+	for (auto& index : data.indices)
+	{
+		index = cluster[index];
+	}
+	data.normals.clear();
+	data.tangents.clear();
+	GatherVertices(data, source);
+}
+
+void OptimizeVertexCache(MeshData& data)
+{
+	// Linear-speed vertex cache optimisation
+	// Reference: https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html
+	Triangulate(data);
+
+	const auto& indices = data.indices;
+	const size_t vertexCount = data.vertices.size();
+	const size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	// Triangles using each vertex, the first remaining[v] entries are not emitted yet
+	std::vector<unsigned int> offsets(vertexCount + 1);
+	for (auto index : indices)
+	{
+		++offsets[index + 1];
+	}
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		offsets[v + 1] += offsets[v];
+	}
+
+	std::vector<unsigned int> remaining(vertexCount);
+	std::vector<unsigned int> adjacency(indices.size());
+	for (size_t t = 0; t < triangleCount; ++t)
+	{
+		for (size_t k = 0; k < 3; ++k)
+		{
+			const auto v = indices[t * 3 + k];
+			adjacency[offsets[v] + remaining[v]++] = static_cast<unsigned int>(t);
+		}
+	}
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> score(vertexCount);
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		score[v] = VertexScore(-1, remaining[v]);
+	}
+
+	std::vector<bool> emitted(triangleCount);
+	std::vector<unsigned int> output;
+	std::vector<unsigned int> order;
+	output.reserve(indices.size());
+	order.reserve(triangleCount);
+
+	std::vector<unsigned int> cache;
+	std::vector<unsigned int> nextCache;
+	cache.reserve(kVertexCacheSize + 3);
+	nextCache.reserve(kVertexCacheSize + 3);
+
+	size_t cursor = 0;
+	int64_t best = -1;
+	while (output.size() < indices.size())
+	{
+		if (best < 0)
+		{
+			// Nothing useful in the cache, restart from the next unused triangle
+			while (emitted[cursor])
+			{
+				++cursor;
+			}
+			best = static_cast<int64_t>(cursor);
+		}
+
+		const auto triangle = static_cast<unsigned int>(best);
+		emitted[triangle] = true;
+		order.emplace_back(triangle);
+
+		nextCache.clear();
+		for (size_t k = 0; k < 3; ++k)
+		{
+			const auto v = indices[triangle * 3 + k];
+			output.emplace_back(v);
+
+			auto first = adjacency.begin() + offsets[v];
+			auto last = first + remaining[v];
+			auto it = std::find(first, last, triangle);
+			if (it != last)
+			{
+				std::iter_swap(it, last - 1);
+				--remaining[v];
+			}
+
+			if (std::find(nextCache.begin(), nextCache.end(), v) == nextCache.end())
+			{
+				nextCache.emplace_back(v);
+			}
+		}
+
+		for (auto v : cache)
+		{
+			if (std::find(nextCache.begin(), nextCache.end(), v) == nextCache.end())
+			{
+				nextCache.emplace_back(v);
+			}
+		}
+
+		// Rescore everything that moved, including the vertices pushed out of the cache
+		for (size_t i = 0; i < nextCache.size(); ++i)
+		{
+			const auto v = nextCache[i];
+			cachePosition[v] = i < kVertexCacheSize ? static_cast<int>(i) : -1;
+			score[v] = VertexScore(cachePosition[v], remaining[v]);
+		}
+
+		if (nextCache.size() > kVertexCacheSize)
+		{
+			nextCache.resize(kVertexCacheSize);
+		}
+		std::swap(cache, nextCache);
+
+		best = -1;
+		float bestScore = -1.0f;
+		for (auto v : cache)
+		{
+			for (unsigned int i = 0; i < remaining[v]; ++i)
+			{
+				const auto t = adjacency[offsets[v] + i];
+				const float triangleScore =
+					score[indices[t * 3]] +
+					score[indices[t * 3 + 1]] +
+					score[indices[t * 3 + 2]];
+
+				if (triangleScore > bestScore)
+				{
+					bestScore = triangleScore;
+					best = t;
+				}
+			}
+		}
+	}
+
+	data.indices.assign(output.begin(), output.end());
+	if (!data.smoothingGroups.empty())
+	{
+		std::vector<unsigned int> groups(triangleCount);
+		for (size_t t = 0; t < triangleCount; ++t)
+		{
+			groups[t] = data.smoothingGroups[order[t]];
+		}
+		data.smoothingGroups.assign(groups.begin(), groups.end());
+	}
+	CompactVertices(data);
+}
+
+void Simplify(MeshData& data, float ratio)
+{
+	// Vertex clustering, every vertex in a grid cell collapses to the cell average
+	// Reference: Rossignac and Borrel, Multi-resolution 3D approximations for rendering complex scenes
+	Triangulate(data);
+
+	const size_t triangleCount = data.indices.size() / 3;
+	if (ratio >= 1.0f || triangleCount == 0)
+	{
+		return;
+	}
+
+	const auto target = static_cast<size_t>(triangleCount * std::max(ratio, 0.0f));
+
+	glm::vec3 lower{ FLT_MAX }, upper{ -FLT_MAX };
+	for (const auto& v : data.vertices)
+	{
+		lower = glm::min(lower, v);
+		upper = glm::max(upper, v);
+	}
+	const auto size = upper - lower;
+	const float extent = std::max(std::max(size.x, size.y), std::max(size.z, 1e-6f));
+
+	std::vector<unsigned int> cluster;
+	const auto survivors = [&](unsigned int resolution)
+	{
+		ClusterVertices(data.vertices, lower, extent / resolution, cluster);
+
+		size_t count = 0;
+		for (size_t t = 0; t < triangleCount; ++t)
+		{
+			const auto a = cluster[data.indices[t * 3]];
+			const auto b = cluster[data.indices[t * 3 + 1]];
+			const auto c = cluster[data.indices[t * 3 + 2]];
+			count += a != b && b != c && a != c;
+		}
+		return count;
+	};
+
+	// Finest grid along the longest axis that still meets the target
+	unsigned int lo = 1, hi = 1u << 20;
+	while (lo < hi)
+	{
+		const auto mid = lo + (hi - lo + 1) / 2;
+		if (survivors(mid) <= target)
+		{
+			lo = mid;
+		}
+		else
+		{
+			hi = mid - 1;
+		}
+	}
+
+	const auto clusterCount = ClusterVertices(data.vertices, lower, extent / lo, cluster);
+
+	std::vector<glm::vec3> vertices(clusterCount);
+	std::vector<unsigned int> members(clusterCount);
+	for (size_t i = 0; i < data.vertices.size(); ++i)
+	{
+		vertices[cluster[i]] += data.vertices[i];
+		++members[cluster[i]];
+	}
+	for (size_t i = 0; i < clusterCount; ++i)
+	{
+		vertices[i] /= static_cast<float>(members[i]);
+	}
+
+	std::vector<unsigned int> indices, groups;
+	indices.reserve(target * 3);
+	for (size_t t = 0; t < triangleCount; ++t)
+	{
+		const auto a = cluster[data.indices[t * 3]];
+		const auto b = cluster[data.indices[t * 3 + 1]];
+		const auto c = cluster[data.indices[t * 3 + 2]];
+		if (a != b && b != c && a != c)
+		{
+			indices.insert(indices.end(), { a, b, c });
+			if (!data.smoothingGroups.empty())
+			{
+				groups.emplace_back(data.smoothingGroups[t]);
+			}
+		}
+	}
+
+	// Clusters average positions only, the other attributes would not match them
+	data.texCoords.clear();
+	data.normals.clear();
+	data.tangents.clear();
+	data.vertices.assign(vertices.begin(), vertices.end());
+	data.indices.assign(indices.begin(), indices.end());
+	data.smoothingGroups.assign(groups.begin(), groups.end());
+	CompactVertices(data);
+}
@@ -0,0 +1,208 @@
+#include "scene_renderer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+#include <numeric>
+#include <stdexcept>
+
+using Clock = std::chrono::steady_clock;
+
+SceneRenderer::SceneRenderer(unsigned int threads) :
+	mDirty{},
+	mBuilder{ threads },
+	mDirectShader{ "assets/shaders/model.vs", "assets/shaders/model.fs" },
+	mIndirect{ IsIndirectSupported() },
+	mVAO{},
+	mVBO{},
+	mEBO{},
+	mCommandBuffer{},
+	mObjectBuffer{},
+	mDrawIdBuffer{},
+	mObjectCapacity{}
+{
+	if (mIndirect)
+	{
+		mIndirectShader.emplace("assets/shaders/model_indirect.vs", "assets/shaders/model.fs");
+	}
+
+	glGenVertexArrays(1, &mVAO);
+	glGenBuffers(1, &mVBO);
+	glGenBuffers(1, &mEBO);
+	glGenBuffers(1, &mCommandBuffer);
+	glGenBuffers(1, &mObjectBuffer);
+	glGenBuffers(1, &mDrawIdBuffer);
+
+	glBindVertexArray(mVAO);
+
+	glBindBuffer(GL_ARRAY_BUFFER, mVBO);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+	glEnableVertexAttribArray(0);
+
+	// One draw ID per instance, baseInstance picks the first one of a command
+	if (mIndirect)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, mDrawIdBuffer);
+		glVertexAttribIPointer(1, 1, GL_UNSIGNED_INT, 0, nullptr);
+		glVertexAttribDivisor(1, 1);
+		glEnableVertexAttribArray(1);
+	}
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mEBO);
+	glBindVertexArray(0);
+}
+
+SceneRenderer::~SceneRenderer()
+{
+	const GLuint buffers[] = { mVBO, mEBO, mCommandBuffer, mObjectBuffer, mDrawIdBuffer };
+	glDeleteBuffers(static_cast<GLsizei>(std::size(buffers)), buffers);
+	glDeleteVertexArrays(1, &mVAO);
+}
+
+bool SceneRenderer::IsIndirectSupported()
+{
+	// Multi-draw indirect and SSBOs are both core in 4.3
+	return GLAD_GL_VERSION_4_3 != 0;
+}
+
+uint32_t SceneRenderer::AddMesh(const MeshData& data)
+{
+	if (!data.faceSizes.empty())
+	{
+		throw std::runtime_error("Scene meshes must be triangulated");
+	}
+
+	const auto range = MakeMeshRange(data.vertices, static_cast<uint32_t>(data.indices.size()),
+		static_cast<uint32_t>(mIndices.size()), static_cast<int32_t>(mVertices.size()));
+
+	mVertices.insert(mVertices.end(), data.vertices.begin(), data.vertices.end());
+	mIndices.insert(mIndices.end(), data.indices.begin(), data.indices.end());
+	mMeshes.emplace_back(range);
+	mDirty = true;
+	return static_cast<uint32_t>(mMeshes.size() - 1);
+}
+
+void SceneRenderer::UploadGeometry()
+{
+	glBindBuffer(GL_ARRAY_BUFFER, mVBO);
+	glBufferData(GL_ARRAY_BUFFER, mVertices.size() * sizeof mVertices[0], mVertices.data(), GL_STATIC_DRAW);
+
+	glBindVertexArray(mVAO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, mIndices.size() * sizeof mIndices[0], mIndices.data(), GL_STATIC_DRAW);
+	glBindVertexArray(0);
+
+	mDirty = false;
+}
+
+void SceneRenderer::ReserveObjects(size_t count)
+{
+	if (count <= mObjectCapacity)
+	{
+		return;
+	}
+	mObjectCapacity = std::max(count, mObjectCapacity * 2);
+
+	std::vector<uint32_t> drawIds(mObjectCapacity);
+	std::iota(drawIds.begin(), drawIds.end(), 0u);
+	glBindBuffer(GL_ARRAY_BUFFER, mDrawIdBuffer);
+	glBufferData(GL_ARRAY_BUFFER, drawIds.size() * sizeof drawIds[0], drawIds.data(), GL_STATIC_DRAW);
+}
+
+void SceneRenderer::Draw(std::span<const DrawObject> objects, const glm::mat4& viewProjection)
+{
+	if (mDirty)
+	{
+		UploadGeometry();
+	}
+
+	const auto start = Clock::now();
+	mBuilder.Build(mMeshes, objects, viewProjection);
+	const auto built = Clock::now();
+
+	const auto commands = mBuilder.GetCommands();
+	const auto models = mBuilder.GetModels();
+
+	mStats.objects = static_cast<unsigned int>(objects.size());
+	mStats.visible = static_cast<unsigned int>(commands.size());
+	mStats.drawCalls = 0;
+	mStats.triangles = 0;
+	for (const auto& command : commands)
+	{
+		mStats.triangles += command.count / 3;
+	}
+
+	if (!commands.empty())
+	{
+		glBindVertexArray(mVAO);
+		if (mIndirect)
+		{
+			DrawIndirect(commands, models, viewProjection);
+		}
+		else
+		{
+			DrawDirect(commands, models, viewProjection);
+		}
+		glBindVertexArray(0);
+	}
+
+	const std::chrono::duration<double, std::milli> buildTime = built - start;
+	const std::chrono::duration<double, std::milli> submitTime = Clock::now() - built;
+	mStats.buildMs = buildTime.count();
+	mStats.submitMs = submitTime.count();
+}
+
+void SceneRenderer::DrawIndirect(std::span<const DrawElementsIndirectCommand> commands, std::span<const glm::mat4> models, const glm::mat4& viewProjection)
+{
+	ReserveObjects(commands.size());
+
+	// Orphan before writing so the driver never waits on the previous frame
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mCommandBuffer);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, mObjectCapacity * sizeof commands[0], nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commands.size_bytes(), commands.data());
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mObjectBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, mObjectCapacity * sizeof models[0], nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, models.size_bytes(), models.data());
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, mObjectBuffer);
+
+	mIndirectShader->Use();
+	mIndirectShader->SetMatrix("viewProjection", viewProjection);
+
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, static_cast<GLsizei>(commands.size()), 0);
+	mStats.drawCalls = 1;
+}
+
+void SceneRenderer::DrawDirect(std::span<const DrawElementsIndirectCommand> commands, std::span<const glm::mat4> models, const glm::mat4& viewProjection)
+{
+	mDirectShader.Use();
+	for (size_t i = 0; i < commands.size(); ++i)
+	{
+		const auto& command = commands[i];
+		mDirectShader.SetMatrix("mvp", viewProjection * models[i]);
+
+		const auto offset = static_cast<size_t>(command.firstIndex) * sizeof(unsigned int);
+		glDrawElementsBaseVertex(GL_TRIANGLES, static_cast<GLsizei>(command.count), GL_UNSIGNED_INT,
+			reinterpret_cast<const void*>(offset), command.baseVertex);
+	}
+	mStats.drawCalls = static_cast<unsigned int>(commands.size());
+}
+
+bool SceneRenderer::IsIndirect() const
+{
+	return mIndirect;
+}
+
+void SceneRenderer::SetIndirect(bool indirect)
+{
+	mIndirect = indirect && mIndirectShader.has_value();
+}
+
+unsigned int SceneRenderer::GetThreadCount() const
+{
+	return mBuilder.GetThreadCount();
+}
+
+const SceneStats& SceneRenderer::GetStats() const
+{
+	return mStats;
+}
@@ -0,0 +1,620 @@
+#include "tangent_space.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cmath>
+#include <stdexcept>
+#include <type_traits>
+
+#include "mesh_processing.hpp"
+
+static constexpr size_t kMinItemsPerThread = 4096;
+
+static
+bool SamePosition(const glm::vec3& a, const glm::vec3& b)
+{
+	return ExactBits(a.x) == ExactBits(b.x) && ExactBits(a.y) == ExactBits(b.y) && ExactBits(a.z) == ExactBits(b.z);
+}
+
+static
+size_t HashPosition(const glm::vec3& v)
+{
+	return HashCoordinates(ExactBits(v.x), ExactBits(v.y), ExactBits(v.z));
+}
+
+static
+glm::vec3 ProjectToPlane(const glm::vec3& v, const glm::vec3& normal)
+{
+	return v - normal * glm::dot(normal, v);
+}
+
+static
+glm::vec3 NormalizeOrZero(const glm::vec3& v)
+{
+	const float length = glm::length(v);
+	return length > 0.0f ? v / length : glm::vec3{};
+}
+
+static
+glm::vec3 AnyPerpendicular(const glm::vec3& normal)
+{
+	const glm::vec3 axis = std::fabs(normal.x) < 0.9f ? glm::vec3{ 1.0f, 0.0f, 0.0f } : glm::vec3{ 0.0f, 1.0f, 0.0f };
+	return NormalizeOrZero(glm::cross(normal, axis));
+}
+
+std::span<const unsigned int> TangentSpaceGenerator::CornerTable::Get(size_t key) const
+{
+	return { corners.data() + offsets[key], corners.data() + offsets[key + 1] };
+}
+
+TangentSpaceGenerator::TangentSpaceGenerator(TangentSpaceOptions options) :
+	mOptions{ options },
+	mCosCrease{ std::cos(glm::radians(std::clamp(options.creaseAngle, 0.0f, 180.0f))) },
+	mPool{ options.threads },
+	mStamp{}
+{
+}
+
+template <typename F>
+void TangentSpaceGenerator::ParallelFor(size_t count, F&& body) const
+{
+	mPool.ParallelFor(count, kMinItemsPerThread, body);
+}
+
+void TangentSpaceGenerator::BuildCornerTable(CornerTable& table, std::span<const unsigned int> keys, size_t keyCount) const
+{
+	std::vector<std::atomic<unsigned int>> counts(keyCount);
+	ParallelFor(keys.size(), [&](size_t first, size_t last)
+	{
+		for (size_t corner = first; corner < last; ++corner)
+		{
+			counts[keys[corner]].fetch_add(1, std::memory_order_relaxed);
+		}
+	});
+
+	table.offsets.resize(keyCount + 1);
+	table.offsets[0] = 0;
+	for (size_t key = 0; key < keyCount; ++key)
+	{
+		table.offsets[key + 1] = table.offsets[key] + counts[key].load(std::memory_order_relaxed);
+		counts[key].store(0, std::memory_order_relaxed);
+	}
+
+	table.corners.resize(keys.size());
+	ParallelFor(keys.size(), [&](size_t first, size_t last)
+	{
+		for (size_t corner = first; corner < last; ++corner)
+		{
+			const auto key = keys[corner];
+			table.corners[table.offsets[key] + counts[key].fetch_add(1, std::memory_order_relaxed)] = static_cast<unsigned int>(corner);
+		}
+	});
+
+	// Threads fill the lists in any order, sorting keeps the results deterministic
+	ParallelFor(keyCount, [&](size_t first, size_t last)
+	{
+		for (size_t key = first; key < last; ++key)
+		{
+			std::sort(table.corners.begin() + table.offsets[key], table.corners.begin() + table.offsets[key + 1]);
+		}
+	});
+}
+
+void TangentSpaceGenerator::SharePositions(const MeshData& data)
+{
+	// Lock free open addressing, every slot ends up holding the lowest vertex of its position
+	const auto& vertices = data.vertices;
+	const size_t mask = std::bit_ceil(std::max<size_t>(vertices.size() * 2, 2)) - 1;
+	std::vector<std::atomic<unsigned int>> slots(mask + 1);
+	ParallelFor(slots.size(), [&](size_t first, size_t last)
+	{
+		for (size_t slot = first; slot < last; ++slot)
+		{
+			slots[slot].store(UINT_MAX, std::memory_order_relaxed);
+		}
+	});
+
+	ParallelFor(vertices.size(), [&](size_t first, size_t last)
+	{
+		for (size_t v = first; v < last; ++v)
+		{
+			const auto vertex = static_cast<unsigned int>(v);
+			for (size_t slot = HashPosition(vertices[v]) & mask; ; slot = (slot + 1) & mask)
+			{
+				auto current = slots[slot].load(std::memory_order_relaxed);
+				if (current == UINT_MAX && slots[slot].compare_exchange_strong(current, vertex, std::memory_order_relaxed))
+				{
+					break;
+				}
+				if (current != UINT_MAX && SamePosition(vertices[current], vertices[v]))
+				{
+					while (vertex < current && !slots[slot].compare_exchange_weak(current, vertex, std::memory_order_relaxed))
+					{
+					}
+					break;
+				}
+			}
+		}
+	});
+
+	mPositionOf.resize(vertices.size());
+	ParallelFor(vertices.size(), [&](size_t first, size_t last)
+	{
+		for (size_t v = first; v < last; ++v)
+		{
+			size_t slot = HashPosition(vertices[v]) & mask;
+			while (!SamePosition(vertices[slots[slot].load(std::memory_order_relaxed)], vertices[v]))
+			{
+				slot = (slot + 1) & mask;
+			}
+			mPositionOf[v] = slots[slot].load(std::memory_order_relaxed);
+		}
+	});
+}
+
+void TangentSpaceGenerator::ComputeFace(const MeshData& data, size_t face)
+{
+	const unsigned int* corner = &data.indices[face * 3];
+	const glm::vec3 p[3] = { data.vertices[corner[0]], data.vertices[corner[1]], data.vertices[corner[2]] };
+
+	mFaceNormals[face] = NormalizeOrZero(glm::cross(p[1] - p[0], p[2] - p[0]));
+	for (int k = 0; k < 3; ++k)
+	{
+		const auto a = NormalizeOrZero(p[(k + 1) % 3] - p[k]);
+		const auto b = NormalizeOrZero(p[(k + 2) % 3] - p[k]);
+		mCornerAngles[face][k] = std::acos(std::clamp(glm::dot(a, b), -1.0f, 1.0f));
+	}
+
+	if (mFaceTangents.empty())
+	{
+		return;
+	}
+
+	// Texture space gradient as in MikkTSpace, degenerate mappings get a zero tangent and orientation
+	const glm::vec2 t[3] = { data.texCoords[corner[0]], data.texCoords[corner[1]], data.texCoords[corner[2]] };
+	const auto t21 = t[1] - t[0];
+	const auto t31 = t[2] - t[0];
+	const float signedArea = t21.x * t31.y - t21.y * t31.x;
+	const auto tangent = (p[1] - p[0]) * t31.y - (p[2] - p[0]) * t21.y;
+	const float length = glm::length(tangent);
+
+	if (signedArea != 0.0f && length > 0.0f)
+	{
+		const float sign = signedArea > 0.0f ? 1.0f : -1.0f;
+		mFaceTangents[face] = glm::vec4(tangent * (sign / length), sign);
+	}
+	else
+	{
+		mFaceTangents[face] = glm::vec4{ 0.0f, 0.0f, 0.0f, 0.0f };
+	}
+}
+
+bool TangentSpaceGenerator::IsSmooth(const MeshData& data, size_t face, size_t other) const
+{
+	if (face == other)
+	{
+		return true;
+	}
+
+	const auto group = data.smoothingGroups.empty() ? 1u : data.smoothingGroups[face];
+	const auto otherGroup = data.smoothingGroups.empty() ? 1u : data.smoothingGroups[other];
+	if (group == 0 || group != otherGroup)
+	{
+		return false;
+	}
+
+	// Degenerate faces have no direction to crease against
+	const auto& normal = mFaceNormals[face];
+	const auto& otherNormal = mFaceNormals[other];
+	const bool degenerate = normal == glm::vec3{} || otherNormal == glm::vec3{};
+	return degenerate || glm::dot(normal, otherNormal) >= mCosCrease;
+}
+
+static
+glm::vec3 FinishNormal(const glm::vec3& sum, const glm::vec3& faceNormal)
+{
+	const float length = glm::length(sum);
+	if (length > 0.0f)
+	{
+		return sum / length;
+	}
+	return faceNormal != glm::vec3{} ? faceNormal : glm::vec3{ 0.0f, 0.0f, 1.0f };
+}
+
+glm::vec3 TangentSpaceGenerator::NormalAt(const MeshData& data, unsigned int corner) const
+{
+	const size_t face = corner / 3;
+	glm::vec3 sum{};
+	for (auto other : mByPosition.Get(mPositionOf[data.indices[corner]]))
+	{
+		if (IsSmooth(data, face, other / 3))
+		{
+			sum += mCornerAngles[other / 3][other % 3] * mFaceNormals[other / 3];
+		}
+	}
+	return FinishNormal(sum, mFaceNormals[face]);
+}
+
+void TangentSpaceGenerator::PositionNormals(const MeshData& data, size_t position, std::span<glm::vec3> cornerNormals) const
+{
+	const auto corners = mByPosition.Get(position);
+	if (corners.empty())
+	{
+		return;
+	}
+
+	// Common case: one smoothing group and every face within half the crease
+	// angle of the average, so every pair is within the crease angle and all
+	// corners share the sum over all faces. This keeps high valence vertices,
+	// like the poles of a sphere, linear instead of quadratic.
+	const auto group = data.smoothingGroups.empty() ? 1u : data.smoothingGroups[corners[0] / 3];
+	bool uniform = group != 0;
+	glm::vec3 sum{};
+	for (auto corner : corners)
+	{
+		const size_t face = corner / 3;
+		uniform = uniform && (data.smoothingGroups.empty() || data.smoothingGroups[face] == group);
+		sum += mCornerAngles[face][corner % 3] * mFaceNormals[face];
+	}
+
+	const auto axis = NormalizeOrZero(sum);
+	const float cosHalfCrease = std::sqrt(std::max(0.0f, (1.0f + mCosCrease) * 0.5f));
+	uniform = uniform && axis != glm::vec3{};
+	for (size_t i = 0; uniform && i < corners.size(); ++i)
+	{
+		const auto& normal = mFaceNormals[corners[i] / 3];
+		uniform = normal == glm::vec3{} || glm::dot(axis, normal) >= cosHalfCrease;
+	}
+
+	for (auto corner : corners)
+	{
+		cornerNormals[corner] = uniform ? axis : NormalAt(data, corner);
+	}
+}
+
+glm::vec4 TangentSpaceGenerator::TangentAt(const MeshData& data, unsigned int vertex) const
+{
+	const auto& normal = data.normals[vertex];
+	const auto& position = data.vertices[vertex];
+	float orientation = 0.0f;
+	glm::vec3 sum{};
+
+	for (auto corner : mByVertex.Get(vertex))
+	{
+		const size_t face = corner / 3;
+		const auto& faceTangent = mFaceTangents[face];
+		if (orientation == 0.0f)
+		{
+			orientation = faceTangent.w;
+		}
+
+		const auto tangent = NormalizeOrZero(ProjectToPlane(glm::vec3(faceTangent), normal));
+		if (tangent == glm::vec3{})
+		{
+			continue;
+		}
+
+		// MikkTSpace weighs by the corner angle measured in the tangent plane
+		const unsigned int* indices = &data.indices[face * 3];
+		const auto k = corner % 3;
+		const auto a = NormalizeOrZero(ProjectToPlane(data.vertices[indices[(k + 1) % 3]] - position, normal));
+		const auto b = NormalizeOrZero(ProjectToPlane(data.vertices[indices[(k + 2) % 3]] - position, normal));
+		sum += std::acos(std::clamp(glm::dot(a, b), -1.0f, 1.0f)) * tangent;
+	}
+
+	const auto tangent = sum != glm::vec3{} ? NormalizeOrZero(sum) : AnyPerpendicular(normal);
+	return glm::vec4(tangent, orientation < 0.0f ? -1.0f : 1.0f);
+}
+
+template <typename T>
+void TangentSpaceGenerator::SplitVertices(std::span<const unsigned int> indices, size_t vertexCount, std::span<const T> cornerValues,
+	std::vector<unsigned int>& splitIndices, std::vector<unsigned int>& source)
+{
+	BuildCornerTable(mByVertex, indices, vertexCount);
+
+	// Corners with the first distinct value keep the vertex, every other value gets a copy
+	std::vector<unsigned int> firstCopy(vertexCount + 1);
+	ParallelFor(vertexCount, [&](size_t first, size_t last)
+	{
+		for (size_t v = first; v < last; ++v)
+		{
+			const auto corners = mByVertex.Get(v);
+			unsigned int distinct = 0;
+			for (size_t i = 0; i < corners.size(); ++i)
+			{
+				size_t j = 0;
+				while (j < i && !(cornerValues[corners[j]] == cornerValues[corners[i]]))
+				{
+					++j;
+				}
+				distinct += j == i;
+			}
+			firstCopy[v + 1] = distinct > 1 ? distinct - 1 : 0;
+		}
+	});
+
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		firstCopy[v + 1] += firstCopy[v];
+	}
+
+	splitIndices.resize(indices.size());
+	source.resize(vertexCount + firstCopy[vertexCount]);
+	ParallelFor(vertexCount, [&](size_t first, size_t last)
+	{
+		for (size_t v = first; v < last; ++v)
+		{
+			const auto corners = mByVertex.Get(v);
+			auto next = static_cast<unsigned int>(vertexCount + firstCopy[v]);
+			source[v] = static_cast<unsigned int>(v);
+			for (size_t i = 0; i < corners.size(); ++i)
+			{
+				const auto corner = corners[i];
+				size_t j = 0;
+				while (j < i && !(cornerValues[corners[j]] == cornerValues[corner]))
+				{
+					++j;
+				}
+
+				// Earlier corners of this vertex are already renumbered
+				if (j < i)
+				{
+					splitIndices[corner] = splitIndices[corners[j]];
+					continue;
+				}
+
+				const auto target = i == 0 ? static_cast<unsigned int>(v) : next++;
+				splitIndices[corner] = target;
+				source[target] = static_cast<unsigned int>(v);
+			}
+		}
+	});
+}
+
+// Rebuilds a per vertex array from the listed source vertices, allocated once at its final size
+template <typename T, typename F>
+static
+void GatherInPlace(std::pmr::vector<T>& values, std::span<const unsigned int> source, F&& parallelFor)
+{
+	if (values.empty())
+	{
+		return;
+	}
+
+	std::pmr::vector<T> result(source.size(), values.get_allocator());
+	parallelFor(source.size(), [&](size_t first, size_t last)
+	{
+		for (size_t v = first; v < last; ++v)
+		{
+			result[v] = values[source[v]];
+		}
+	});
+	values = std::move(result);
+}
+
+void TangentSpaceGenerator::Generate(MeshData& data)
+{
+	Triangulate(data);
+	data.normals.clear();
+	data.tangents.clear();
+	if (mOptions.tangents && data.texCoords.empty())
+	{
+		throw std::runtime_error("Tangent generation needs texture coordinates");
+	}
+
+	const size_t faceCount = data.indices.size() / 3;
+	const size_t cornerCount = faceCount * 3;
+
+	SharePositions(data);
+	mFaceNormals.resize(faceCount);
+	mCornerAngles.resize(faceCount);
+	mFaceTangents.assign(mOptions.tangents ? faceCount : 0, glm::vec4{});
+	ParallelFor(faceCount, [&](size_t first, size_t last)
+	{
+		for (size_t face = first; face < last; ++face)
+		{
+			ComputeFace(data, face);
+		}
+	});
+
+	// Normals per corner from the faces around its position
+	std::vector<unsigned int> keys(cornerCount);
+	ParallelFor(cornerCount, [&](size_t first, size_t last)
+	{
+		for (size_t corner = first; corner < last; ++corner)
+		{
+			keys[corner] = mPositionOf[data.indices[corner]];
+		}
+	});
+	BuildCornerTable(mByPosition, keys, data.vertices.size());
+
+	std::vector<glm::vec3> cornerNormals(cornerCount);
+	ParallelFor(data.vertices.size(), [&](size_t first, size_t last)
+	{
+		for (size_t position = first; position < last; ++position)
+		{
+			PositionNormals(data, position, cornerNormals);
+		}
+	});
+
+	// One vertex per distinct normal, and with tangents per orientation too.
+	// Both splits only remap indices, the mesh arrays are rebuilt once after.
+	std::vector<unsigned int> splitIndices, source;
+	SplitVertices<glm::vec3>(data.indices, data.vertices.size(), cornerNormals, splitIndices, source);
+
+	if (mOptions.tangents)
+	{
+		// Split where mirrored and unmirrored texture mappings meet, degenerate
+		// mappings join whichever side the vertex has
+		const size_t normalVertexCount = source.size();
+		BuildCornerTable(mByVertex, splitIndices, normalVertexCount);
+		std::vector<float> orientations(cornerCount);
+		ParallelFor(normalVertexCount, [&](size_t first, size_t last)
+		{
+			for (size_t v = first; v < last; ++v)
+			{
+				float fallback = 1.0f;
+				for (auto corner : mByVertex.Get(v))
+				{
+					if (mFaceTangents[corner / 3].w != 0.0f)
+					{
+						fallback = mFaceTangents[corner / 3].w;
+						break;
+					}
+				}
+				for (auto corner : mByVertex.Get(v))
+				{
+					const float w = mFaceTangents[corner / 3].w;
+					orientations[corner] = w != 0.0f ? w : fallback;
+				}
+			}
+		});
+
+		std::vector<unsigned int> orientedIndices, orientedSource;
+		SplitVertices<float>(splitIndices, normalVertexCount, orientations, orientedIndices, orientedSource);
+		for (auto& vertex : orientedSource)
+		{
+			vertex = source[vertex];
+		}
+		splitIndices.swap(orientedIndices);
+		source.swap(orientedSource);
+	}
+
+	const auto parallelFor = [this](size_t count, auto&& body) { ParallelFor(count, body); };
+	std::copy(splitIndices.begin(), splitIndices.end(), data.indices.begin());
+	GatherInPlace(data.vertices, source, parallelFor);
+	GatherInPlace(data.texCoords, source, parallelFor);
+
+	std::vector<unsigned int> positionOf(source.size());
+	ParallelFor(source.size(), [&](size_t first, size_t last)
+	{
+		for (size_t v = first; v < last; ++v)
+		{
+			positionOf[v] = mPositionOf[source[v]];
+		}
+	});
+	mPositionOf.swap(positionOf);
+
+	const size_t vertexCount = data.vertices.size();
+	BuildCornerTable(mByVertex, data.indices, vertexCount);
+	mCornerOf.resize(vertexCount);
+	data.normals.resize(vertexCount);
+	ParallelFor(vertexCount, [&](size_t first, size_t last)
+	{
+		for (size_t v = first; v < last; ++v)
+		{
+			// Corners keep their numbers through the splits, so any corner of the vertex has its normal
+			const auto corners = mByVertex.Get(v);
+			mCornerOf[v] = corners.empty() ? UINT_MAX : corners[0];
+			data.normals[v] = corners.empty() ? glm::vec3{ 0.0f, 0.0f, 1.0f } : cornerNormals[corners[0]];
+		}
+	});
+
+	if (mOptions.tangents)
+	{
+		data.tangents.resize(vertexCount);
+		ParallelFor(vertexCount, [&](size_t first, size_t last)
+		{
+			for (size_t v = first; v < last; ++v)
+			{
+				data.tangents[v] = TangentAt(data, static_cast<unsigned int>(v));
+			}
+		});
+	}
+
+	mPositionStamps.assign(vertexCount, 0);
+	mVertexStamps.assign(vertexCount, 0);
+	mFaceStamps.assign(faceCount, 0);
+	mStamp = 0;
+}
+
+void TangentSpaceGenerator::Update(MeshData& data, std::span<const unsigned int> changedVertices)
+{
+	if (data.normals.size() != data.vertices.size() || mCornerOf.size() != data.vertices.size())
+	{
+		throw std::runtime_error("Tangent space update needs the mesh from the last Generate");
+	}
+
+	// Move every copy of a changed position and collect the faces around them
+	std::vector<unsigned int> faces;
+	++mStamp;
+	for (auto vertex : changedVertices)
+	{
+		const auto position = mPositionOf.at(vertex);
+		for (auto corner : mByPosition.Get(position))
+		{
+			data.vertices[data.indices[corner]] = data.vertices[vertex];
+			if (mFaceStamps[corner / 3] != mStamp)
+			{
+				mFaceStamps[corner / 3] = mStamp;
+				faces.emplace_back(corner / 3);
+			}
+		}
+	}
+
+	ParallelFor(faces.size(), [&](size_t first, size_t last)
+	{
+		for (size_t i = first; i < last; ++i)
+		{
+			ComputeFace(data, faces[i]);
+		}
+	});
+
+	// Every vertex at a corner position of those faces sums at least one of them
+	std::vector<unsigned int> vertices;
+	++mStamp;
+	for (auto face : faces)
+	{
+		for (size_t k = 0; k < 3; ++k)
+		{
+			const auto position = mPositionOf[data.indices[face * 3 + k]];
+			if (mPositionStamps[position] == mStamp)
+			{
+				continue;
+			}
+			mPositionStamps[position] = mStamp;
+
+			for (auto corner : mByPosition.Get(position))
+			{
+				const auto vertex = data.indices[corner];
+				if (mVertexStamps[vertex] != mStamp)
+				{
+					mVertexStamps[vertex] = mStamp;
+					vertices.emplace_back(vertex);
+				}
+			}
+		}
+	}
+
+	ParallelFor(vertices.size(), [&](size_t first, size_t last)
+	{
+		for (size_t i = first; i < last; ++i)
+		{
+			data.normals[vertices[i]] = NormalAt(data, mCornerOf[vertices[i]]);
+		}
+	});
+
+	if (!data.tangents.empty())
+	{
+		ParallelFor(vertices.size(), [&](size_t first, size_t last)
+		{
+			for (size_t i = first; i < last; ++i)
+			{
+				data.tangents[vertices[i]] = TangentAt(data, vertices[i]);
+			}
+		});
+	}
+}
+
+void GenerateNormals(MeshData& data, float creaseAngle, unsigned int threads)
+{
+	TangentSpaceGenerator generator{ TangentSpaceOptions{ creaseAngle, false, threads } };
+	generator.Generate(data);
+}
+
+void GenerateTangents(MeshData& data, float creaseAngle, unsigned int threads)
+{
+	TangentSpaceGenerator generator{ TangentSpaceOptions{ creaseAngle, true, threads } };
+	generator.Generate(data);
+}
@@ -0,0 +1,278 @@
+#include "tangent_space_check.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <ostream>
+#include <tuple>
+#include <vector>
+
+#include "mesh_processing.hpp"
+#include "tangent_space.hpp"
+
+// Largest accepted 1 - dot between a result and the reference
+static constexpr float kNormalTolerance = 1e-4f;
+static constexpr float kTangentTolerance = 1e-3f;
+
+using PositionKey = std::tuple<uint32_t, uint32_t, uint32_t>;
+
+static
+PositionKey MakePositionKey(const glm::vec3& p)
+{
+	return { ExactBits(p.x), ExactBits(p.y), ExactBits(p.z) };
+}
+
+static
+glm::vec3 SafeNormalize(const glm::vec3& v)
+{
+	const float length = glm::length(v);
+	return length > 0.0f ? v / length : glm::vec3{};
+}
+
+static
+float CornerAngle(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b)
+{
+	return std::acos(std::clamp(glm::dot(SafeNormalize(a - p), SafeNormalize(b - p)), -1.0f, 1.0f));
+}
+
+struct CheckError
+{
+	float normal = 0.0f;
+	float tangent = 0.0f;
+	size_t orientation = 0;	// corners whose bitangent sign disagrees
+};
+
+// Direct evaluation of the definitions in tangent_space.hpp for every corner.
+// A vertex shares the normal of its first corner and averages tangents over
+// all of its corners, which is what Update keeps to since it does not redo
+// the splits. With allCorners the normal of every corner has to match, which
+// checks the splits of Generate as well.
+static
+CheckError CompareWithReference(const MeshData& data, float creaseAngle, bool allCorners)
+{
+	const size_t faceCount = data.indices.size() / 3;
+	const float cosCrease = std::cos(glm::radians(std::clamp(creaseAngle, 0.0f, 180.0f)));
+	const auto group = [&](size_t face) { return data.smoothingGroups.empty() ? 1u : data.smoothingGroups[face]; };
+	const auto position = [&](size_t corner) { return data.vertices[data.indices[corner]]; };
+
+	std::vector<glm::vec3> faceNormals(faceCount);
+	std::vector<glm::vec4> faceTangents(faceCount);
+	for (size_t face = 0; face < faceCount; ++face)
+	{
+		const auto p0 = position(face * 3), p1 = position(face * 3 + 1), p2 = position(face * 3 + 2);
+		faceNormals[face] = SafeNormalize(glm::cross(p1 - p0, p2 - p0));
+		if (data.texCoords.empty())
+		{
+			continue;
+		}
+
+		const auto t0 = data.texCoords[data.indices[face * 3]];
+		const auto t21 = data.texCoords[data.indices[face * 3 + 1]] - t0;
+		const auto t31 = data.texCoords[data.indices[face * 3 + 2]] - t0;
+		const float area = t21.x * t31.y - t21.y * t31.x;
+		const auto tangent = SafeNormalize((p1 - p0) * t31.y - (p2 - p0) * t21.y);
+		if (area != 0.0f && tangent != glm::vec3{})
+		{
+			const float sign = area > 0.0f ? 1.0f : -1.0f;
+			faceTangents[face] = glm::vec4(tangent * sign, sign);
+		}
+	}
+
+	std::map<PositionKey, std::vector<size_t>> cornersAt;
+	for (size_t corner = 0; corner < data.indices.size(); ++corner)
+	{
+		cornersAt[MakePositionKey(position(corner))].push_back(corner);
+	}
+
+	// Angle weighted face normals over the smooth faces around the position
+	std::vector<glm::vec3> normals(data.indices.size());
+	for (const auto& [key, corners] : cornersAt)
+	{
+		for (auto corner : corners)
+		{
+			const size_t face = corner / 3;
+			glm::vec3 sum{};
+			for (auto other : corners)
+			{
+				const size_t otherFace = other / 3;
+				const bool degenerate = faceNormals[face] == glm::vec3{} || faceNormals[otherFace] == glm::vec3{};
+				const bool smooth = face == otherFace || (group(face) != 0 && group(face) == group(otherFace) &&
+					(degenerate || glm::dot(faceNormals[face], faceNormals[otherFace]) >= cosCrease));
+				if (smooth)
+				{
+					const size_t k = other % 3;
+					const size_t base = otherFace * 3;
+					sum += CornerAngle(position(other), position(base + (k + 1) % 3), position(base + (k + 2) % 3)) * faceNormals[otherFace];
+				}
+			}
+
+			const float length = glm::length(sum);
+			normals[corner] = length > 0.0f ? sum / length :
+				faceNormals[face] != glm::vec3{} ? faceNormals[face] : glm::vec3{ 0.0f, 0.0f, 1.0f };
+		}
+	}
+
+	std::vector<glm::vec3> vertexNormals(data.vertices.size());
+	std::vector<bool> seen(data.vertices.size());
+	CheckError error;
+	for (size_t corner = 0; corner < data.indices.size(); ++corner)
+	{
+		const auto vertex = data.indices[corner];
+		if (allCorners || !seen[vertex])
+		{
+			error.normal = std::max(error.normal, 1.0f - glm::dot(normals[corner], data.normals[vertex]));
+		}
+		if (!seen[vertex])
+		{
+			vertexNormals[vertex] = normals[corner];
+			seen[vertex] = true;
+		}
+	}
+	if (data.tangents.empty())
+	{
+		return error;
+	}
+
+	// Projected face tangents weighted by the projected corner angle. Corners
+	// with degenerate texture coordinates take their neighbours' tangent.
+	std::vector<glm::vec3> tangents(data.vertices.size());
+	for (size_t corner = 0; corner < data.indices.size(); ++corner)
+	{
+		const auto vertex = data.indices[corner];
+		const auto& faceTangent = faceTangents[corner / 3];
+		if (faceTangent.w == 0.0f)
+		{
+			continue;
+		}
+		error.orientation += data.tangents[vertex].w != faceTangent.w;
+
+		const auto& normal = vertexNormals[vertex];
+		const auto project = [&](const glm::vec3& v) { return SafeNormalize(v - normal * glm::dot(normal, v)); };
+		const size_t k = corner % 3;
+		const size_t base = corner - k;
+		const auto p = position(corner);
+		const auto a = project(position(base + (k + 1) % 3) - p);
+		const auto b = project(position(base + (k + 2) % 3) - p);
+		tangents[vertex] += std::acos(std::clamp(glm::dot(a, b), -1.0f, 1.0f)) * project(glm::vec3(faceTangent));
+	}
+
+	for (size_t vertex = 0; vertex < tangents.size(); ++vertex)
+	{
+		if (tangents[vertex] != glm::vec3{})
+		{
+			error.tangent = std::max(error.tangent, 1.0f - glm::dot(SafeNormalize(tangents[vertex]), glm::vec3(data.tangents[vertex])));
+		}
+	}
+	return error;
+}
+
+static
+bool SameResult(const MeshData& a, const MeshData& b)
+{
+	const auto same = [](const auto& x, const auto& y)
+	{
+		return x.size() == y.size() && (x.empty() || std::memcmp(x.data(), y.data(), x.size() * sizeof x[0]) == 0);
+	};
+	return same(a.indices, b.indices) && same(a.vertices, b.vertices) && same(a.normals, b.normals) && same(a.tangents, b.tangents);
+}
+
+static
+bool Report(std::ostream& os, std::string_view what, const CheckError& error, bool tangents)
+{
+	const bool ok = error.normal <= kNormalTolerance && error.tangent <= kTangentTolerance && error.orientation == 0;
+	os << "  " << what << ": normal error " << error.normal;
+	if (tangents)
+	{
+		os << ", tangent error " << error.tangent << ", flipped " << error.orientation;
+	}
+	os << (ok ? "" : "  FAILED") << "\n";
+	return ok;
+}
+
+bool CheckTangentSpace(std::string_view name, const std::function<MeshData()>& load, float creaseAngle,
+	unsigned int maxThreads, std::ostream& os)
+{
+	bool ok = true;
+	const bool textured = !load().texCoords.empty();
+
+	for (int pass = 0; pass < (textured ? 2 : 1); ++pass)
+	{
+		const bool tangents = pass == 1;
+
+		// Every thread count has to reproduce the single threaded result exactly
+		auto single = load();
+		TangentSpaceGenerator{ TangentSpaceOptions{ creaseAngle, tangents, 1 } }.Generate(single);
+
+		for (unsigned int threads = 1; ; threads = std::min(threads * 2, maxThreads))
+		{
+			os << name << (tangents ? ", normals and tangents, " : ", normals, ") << threads << " thread" << (threads > 1 ? "s" : "") << "\n";
+			const TangentSpaceOptions options{ creaseAngle, tangents, threads };
+
+			auto data = load();
+			TangentSpaceGenerator generator{ options };
+			generator.Generate(data);
+			ok = Report(os, "generate", CompareWithReference(data, creaseAngle, true), tangents) && ok;
+			if (!SameResult(single, data))
+			{
+				os << "  generate: differs from the single threaded result  FAILED\n";
+				ok = false;
+			}
+
+			// Push some positions outwards a little, Update moves their copies along
+			std::vector<unsigned int> changed;
+			for (unsigned int v = 0; v < data.vertices.size(); v += 17)
+			{
+				data.vertices[v] *= 1.001f;
+				changed.push_back(v);
+			}
+			generator.Update(data, changed);
+			ok = Report(os, "update", CompareWithReference(data, creaseAngle, false), tangents) && ok;
+
+			if (threads == maxThreads)
+			{
+				break;
+			}
+		}
+	}
+	return ok;
+}
+
+MeshData MakeCheckSphere(unsigned int rings)
+{
+	const unsigned int n = std::max(rings, 4u);
+	const unsigned int columns = 2 * n + 1;
+	const float pi = 3.14159265358979f;
+
+	MeshData data;
+	for (unsigned int i = 0; i <= n; ++i)
+	{
+		for (unsigned int j = 0; j < columns; ++j)
+		{
+			const float theta = pi * i / n, phi = pi * j / n;
+			const bool pole = i == 0 || i == n;
+			data.vertices.emplace_back(pole ? glm::vec3{ 0.0f, 0.0f, i == 0 ? 1.0f : -1.0f } :
+				glm::vec3{ std::sin(theta) * std::cos(phi), std::sin(theta) * std::sin(phi), std::cos(theta) });
+
+			// The second half mirrors the texture of the first
+			const float u = static_cast<float>(j <= n ? j : 2 * n - j) / (2 * n);
+			data.texCoords.emplace_back(u, static_cast<float>(i) / n);
+		}
+	}
+
+	for (unsigned int i = 0; i < n; ++i)
+	{
+		const unsigned int group = i == n / 4 ? 0 : (i < n / 2 ? 1 : 2);
+		for (unsigned int j = 0; j < 2 * n; ++j)
+		{
+			const unsigned int a = i * columns + j, b = a + columns, c = b + 1, e = a + 1;
+			for (auto index : { a, b, c, a, c, e })
+			{
+				data.indices.push_back(index);
+			}
+			data.smoothingGroups.push_back(group);
+			data.smoothingGroups.push_back(group);
+		}
+	}
+	return data;
+}
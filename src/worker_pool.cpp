@@ -0,0 +1,96 @@
+#include "worker_pool.hpp"
+
+WorkerPool::WorkerPool(unsigned int threads) :
+	mTask{},
+	mBody{},
+	mGeneration{},
+	mPending{},
+	mActive{ 1 },
+	mStop{}
+{
+	if (threads == 0)
+	{
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	for (unsigned int worker = 1; worker < threads; ++worker)
+	{
+		mWorkers.emplace_back(&WorkerPool::WorkerLoop, this, worker);
+	}
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard lock{ mMutex };
+		mStop = true;
+	}
+	mStart.notify_all();
+	for (auto& worker : mWorkers)
+	{
+		worker.join();
+	}
+}
+
+unsigned int WorkerPool::GetThreadCount() const
+{
+	return static_cast<unsigned int>(mWorkers.size() + 1);
+}
+
+unsigned int WorkerPool::GetActiveCount(size_t count, size_t minItemsPerWorker) const
+{
+	return static_cast<unsigned int>(std::clamp<size_t>(count / std::max<size_t>(minItemsPerWorker, 1), 1, GetThreadCount()));
+}
+
+void WorkerPool::Dispatch(Task task, void* body, unsigned int active)
+{
+	{
+		std::lock_guard lock{ mMutex };
+		mTask = task;
+		mBody = body;
+		mActive = active;
+		mPending = active - 1;
+		++mGeneration;
+	}
+	mStart.notify_all();
+
+	task(body, 0, active);
+
+	std::unique_lock lock{ mMutex };
+	mDone.wait(lock, [this] { return mPending == 0; });
+}
+
+void WorkerPool::WorkerLoop(unsigned int worker)
+{
+	uint64_t generation = 0;
+	while (true)
+	{
+		Task task;
+		void* body;
+		unsigned int active;
+		{
+			std::unique_lock lock{ mMutex };
+			mStart.wait(lock, [&] { return mStop || mGeneration != generation; });
+			if (mStop)
+			{
+				return;
+			}
+			generation = mGeneration;
+			task = mTask;
+			body = mBody;
+			active = mActive;
+			if (worker >= active)
+			{
+				continue;
+			}
+		}
+
+		task(body, worker, active);
+
+		std::lock_guard lock{ mMutex };
+		if (--mPending == 0)
+		{
+			mDone.notify_one();
+		}
+	}
+}